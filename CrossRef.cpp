@@ -0,0 +1,131 @@
+#include "common.h"
+
+#include "CrossRef.h"
+#include "TscCommands.h"
+
+static const std::vector<uint16_t> no_entities;
+
+CrossRef::CrossRef() {
+    entities_hash = 0;
+    entities_size = 0;
+}
+
+void CrossRef::UpdateEntities(const PXE &pxe) {
+    uint32_t hash = pxe.Hash();
+    if(hash == entities_hash && pxe.Size() == entities_size) return;
+    entities_hash = hash;
+    entities_size = pxe.Size();
+    event_entities.clear();
+    flag_entities.clear();
+    triggered.clear();
+    for(uint16_t i = 0; i < pxe.Size(); i++) {
+        Entity e = pxe.GetEntity(i);
+        if(e.event) {
+            event_entities[e.event].push_back(i);
+            if(e.flags & (ENTITY_INTERACTIVE | ENTITY_CALL_ON_DEATH)) triggered.push_back(e.event);
+        }
+        if(e.flags & (ENTITY_ENABLE_ON_FLAG | ENTITY_DISABLE_ON_FLAG)) flag_entities[e.id].push_back(i);
+    }
+    std::sort(triggered.begin(), triggered.end());
+    triggered.erase(std::unique(triggered.begin(), triggered.end()), triggered.end());
+}
+
+// References in the lines starting within [from, to)
+void CrossRef::Scan(const char *text, size_t from, size_t to, std::vector<ScriptRef> &out) {
+    const TscCommand *fl_set = FindTscCommand("FL+"), *fl_clear = FindTscCommand("FL-"), *tra = FindTscCommand("TRA");
+    const char *end = text + to;
+    for(const char *p = text + from; p < end; p++) {
+        p = (const char*) memchr(p, '<', end - p);
+        if(!p) break;
+        const char *eol = (const char*) memchr(p, '\n', end - p);
+        if(!eol) eol = end;
+        const TscCommand *cmd = eol - p >= 4 ? FindTscCommand(p + 1) : NULL;
+        // <TRA's event is in another stage's script
+        if(!cmd || cmd == tra) continue;
+        for(int i = 0; i < cmd->argc; i++) {
+            const char *arg = p + 4 + i * (TSC_ARG_LEN + 1);
+            if(eol - arg < TSC_ARG_LEN) break;
+            uint16_t id = 0;
+            bool digits = true;
+            for(int d = 0; d < TSC_ARG_LEN; d++) {
+                digits = digits && isdigit((uint8_t) arg[d]);
+                id = id * 10 + (arg[d] - '0');
+            }
+            if(!digits) break;
+            uint8_t kind;
+            if(cmd->args[i] == TSC_ARG_EVENT) kind = XREF_EVENT_JUMP;
+            else if(cmd->args[i] != TSC_ARG_FLAG) continue;
+            else kind = cmd == fl_set ? XREF_FLAG_SET : cmd == fl_clear ? XREF_FLAG_CLEAR : XREF_FLAG_TEST;
+            out.push_back({ (uint32_t) (p - text), id, kind });
+        }
+    }
+}
+
+void CrossRef::Count(const std::vector<ScriptRef>::const_iterator &from, const std::vector<ScriptRef>::const_iterator &to, int delta) {
+    for(auto it = from; it != to; it++) {
+        if(it->kind != XREF_EVENT_JUMP) continue;
+        if((jumps[it->id] += delta) == 0) jumps.erase(it->id);
+    }
+}
+
+void CrossRef::BuildScript(const char *text, size_t len) {
+    refs.clear();
+    jumps.clear();
+    Scan(text, 0, len, refs);
+    Count(refs.begin(), refs.end(), 1);
+}
+
+void CrossRef::UpdateScript(const char *text, size_t len, const ScriptEdit &edit) {
+    // Same line range as TscIndex::Update
+    size_t from = edit.pos, to = edit.pos + edit.inserted;
+    while(from > 0 && text[from - 1] != '\n') from--;
+    while(to < len && text[to] != '\n') to++;
+    size_t old_to = to - edit.inserted + edit.removed;
+    std::vector<ScriptRef> found;
+    Scan(text, from, to, found);
+    auto first = std::lower_bound(refs.begin(), refs.end(), from,
+                                  [](const ScriptRef &r, size_t pos) { return r.pos < pos; });
+    auto last = std::lower_bound(first, refs.end(), old_to,
+                                 [](const ScriptRef &r, size_t pos) { return r.pos < pos; });
+    for(auto it = last; it != refs.end(); it++) it->pos = it->pos - edit.removed + edit.inserted;
+    Count(first, last, -1);
+    first = refs.erase(first, last);
+    first = refs.insert(first, found.begin(), found.end());
+    Count(first, first + found.size(), 1);
+}
+
+const std::vector<uint16_t>& CrossRef::EventEntities(uint16_t event) const {
+    auto it = event_entities.find(event);
+    return it == event_entities.end() ? no_entities : it->second;
+}
+
+const std::vector<uint16_t>& CrossRef::FlagEntities(uint16_t flag) const {
+    auto it = flag_entities.find(flag);
+    return it == flag_entities.end() ? no_entities : it->second;
+}
+
+std::vector<ScriptRef> CrossRef::ScriptUses(uint16_t id, bool flag) const {
+    std::vector<ScriptRef> uses;
+    for(auto &r : refs) {
+        if(r.id == id && (r.kind != XREF_EVENT_JUMP) == flag) uses.push_back(r);
+    }
+    return uses;
+}
+
+std::vector<uint16_t> CrossRef::UnusedEvents(const TscIndex &index) const {
+    std::vector<uint16_t> unused;
+    for(auto &ev : index.Events()) {
+        if(!event_entities.count(ev.event) && !jumps.count(ev.event)) unused.push_back(ev.event);
+    }
+    return unused;
+}
+
+std::vector<uint16_t> CrossRef::DanglingEvents(const TscIndex &index, const TscIndex &head) const {
+    std::vector<uint16_t> dangling;
+    auto defined = [&](uint16_t event) { return index.Find(event) || head.Find(event); };
+    for(uint16_t event : triggered) if(!defined(event)) dangling.push_back(event);
+    for(auto &j : jumps) if(!defined(j.first)) dangling.push_back(j.first);
+    std::sort(dangling.begin(), dangling.end());
+    dangling.erase(std::unique(dangling.begin(), dangling.end()), dangling.end());
+    return dangling;
+}
@@ -0,0 +1,53 @@
+#ifndef STAGE9_CROSSREF_H
+#define STAGE9_CROSSREF_H
+
+#include "PXE.h"
+#include "TscIndex.h"
+
+// Entity flag bits that tie an entity to an event or a flag
+#define ENTITY_CALL_ON_DEATH   0x0200
+#define ENTITY_ENABLE_ON_FLAG  0x0800
+#define ENTITY_INTERACTIVE     0x2000
+#define ENTITY_DISABLE_ON_FLAG 0x4000
+
+enum { XREF_EVENT_JUMP, XREF_FLAG_SET, XREF_FLAG_CLEAR, XREF_FLAG_TEST };
+
+typedef struct {
+    uint32_t pos; // The command's '<'
+    uint16_t id;  // Event or flag
+    uint8_t kind;
+} ScriptRef;
+
+// Which entities and script commands use each event and flag of the open stage. Entities are
+// re-indexed whenever they change (there are only a few hundred), the script's references are
+// kept up to date line by line like TscIndex
+class CrossRef {
+public:
+    CrossRef();
+    void UpdateEntities(const PXE &pxe);
+    void BuildScript(const char *text, size_t len);
+    void UpdateScript(const char *text, size_t len, const ScriptEdit &edit);
+
+    // Entities with this event number / using this flag ID to show or hide
+    const std::vector<uint16_t>& EventEntities(uint16_t event) const;
+    const std::vector<uint16_t>& FlagEntities(uint16_t flag) const;
+    // Commands jumping to an event, or setting, clearing or testing a flag, in script order
+    std::vector<ScriptRef> ScriptUses(uint16_t id, bool flag) const;
+    // Events the script has that no entity and no command in it refers to
+    std::vector<uint16_t> UnusedEvents(const TscIndex &index) const;
+    // Events an entity runs (when talked to or killed) or the script jumps to, that neither it nor Head.tsc has
+    std::vector<uint16_t> DanglingEvents(const TscIndex &index, const TscIndex &head) const;
+
+private:
+    uint32_t entities_hash;
+    uint16_t entities_size;
+    std::unordered_map<uint16_t, std::vector<uint16_t>> event_entities, flag_entities;
+    std::vector<uint16_t> triggered; // Events an entity actually runs
+    std::vector<ScriptRef> refs; // In script order
+    std::unordered_map<uint16_t, int> jumps; // How many commands jump to each event
+
+    static void Scan(const char *text, size_t from, size_t to, std::vector<ScriptRef> &out);
+    void Count(const std::vector<ScriptRef>::const_iterator &from, const std::vector<ScriptRef>::const_iterator &to, int delta);
+};
+
+#endif //STAGE9_CROSSREF_H
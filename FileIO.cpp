@@ -0,0 +1,50 @@
+#include "common.h"
+#include <cerrno>
+#ifdef _WIN32
+#include <io.h>
+#define fsync _commit
+#else
+#include <unistd.h>
+#endif
+
+#include "FileIO.h"
+
+bool WriteFileAtomic(const std::string &path, const void *data, size_t len, std::string *error) {
+    std::string tmp = path + ".tmp";
+    FILE *file = fopen(tmp.c_str(), "wb");
+    if(!file) {
+        if(error) *error = tmp + ": " + strerror(errno);
+        return false;
+    }
+    bool ok = fwrite(data, 1, len, file) == len;
+    ok = ok && fflush(file) == 0;
+    ok = ok && fsync(fileno(file)) == 0;
+    if(!ok && error) *error = tmp + ": " + strerror(errno);
+    if(fclose(file) != 0 && ok) {
+        if(error) *error = tmp + ": " + strerror(errno);
+        ok = false;
+    }
+    if(!ok) {
+        remove(tmp.c_str());
+        return false;
+    }
+    std::error_code ec;
+    std::filesystem::rename(tmp, path, ec);
+    if(ec) {
+        if(error) *error = path + ": " + ec.message();
+        remove(tmp.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool ReadAll(const std::string &path, std::vector<uint8_t> &data) {
+    FILE *file = fopen(path.c_str(), "rb");
+    if(!file) return false;
+    fseek(file, 0, SEEK_END);
+    data.resize(ftell(file));
+    fseek(file, 0, SEEK_SET);
+    data.resize(fread(data.data(), 1, data.size(), file));
+    fclose(file);
+    return true;
+}
@@ -0,0 +1,11 @@
+#ifndef STAGE9_FILEIO_H
+#define STAGE9_FILEIO_H
+
+// Writes to path.tmp, flushes it to disk and renames it over path, so a crash or full
+// disk leaves either the old file or the new one, never half of each. On failure the
+// reason is stored in error (if given) and the original file is untouched
+bool WriteFileAtomic(const std::string &path, const void *data, size_t len, std::string *error = NULL);
+// Reads the whole file into data, false if it can't be opened
+bool ReadAll(const std::string &path, std::vector<uint8_t> &data);
+
+#endif //STAGE9_FILEIO_H
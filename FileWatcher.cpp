@@ -0,0 +1,124 @@
+#include "common.h"
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+#include "FileWatcher.h"
+
+#ifdef __linux__
+
+FileWatcher::FileWatcher() {
+    changed = settling = 0;
+    quit = false;
+    fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if(fd < 0) {
+        printf("Error: Failed to start watching files: %s\n", strerror(errno));
+        return;
+    }
+    thread = std::thread(&FileWatcher::Worker, this);
+}
+
+FileWatcher::~FileWatcher() {
+    if(fd < 0) return;
+    quit = true;
+    thread.join();
+    close(fd);
+}
+
+void FileWatcher::Watch(int slot, const std::vector<std::string> &paths) {
+    std::lock_guard<std::mutex> lock(mutex);
+    files[slot].clear();
+    for(auto &p : paths) {
+        std::filesystem::path path(p);
+        std::string dir = path.parent_path().string();
+        files[slot].push_back({ dir.empty() ? "." : dir, path.filename().string() });
+    }
+    settling &= ~(1u << slot);
+    changed &= ~(1u << slot);
+    UpdateDirs();
+}
+
+// Called with the mutex held
+void FileWatcher::UpdateDirs() {
+    if(fd < 0) return;
+    std::set<std::string> wanted;
+    for(auto &slot : files) {
+        for(auto &f : slot) wanted.insert(f.dir);
+    }
+    for(auto it = dirs.begin(); it != dirs.end();) {
+        if(wanted.count(it->first)) {
+            ++it;
+            continue;
+        }
+        inotify_rm_watch(fd, it->second);
+        it = dirs.erase(it);
+    }
+    for(auto &dir : wanted) {
+        if(dirs.count(dir)) continue;
+        int wd = inotify_add_watch(fd, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+        if(wd >= 0) dirs[dir] = wd;
+    }
+}
+
+uint32_t FileWatcher::Changed() {
+    std::lock_guard<std::mutex> lock(mutex);
+    uint32_t result = changed;
+    changed = 0;
+    return result;
+}
+
+void FileWatcher::Worker() {
+    alignas(struct inotify_event) char buf[4096];
+    while(!quit) {
+        struct pollfd pfd = { fd, POLLIN, 0 };
+        int ready = poll(&pfd, 1, 50);
+        std::lock_guard<std::mutex> lock(mutex);
+        auto now = std::chrono::steady_clock::now();
+        if(ready > 0) {
+            ssize_t len;
+            while((len = read(fd, buf, sizeof(buf))) > 0) {
+                for(char *p = buf; p < buf + len; p += sizeof(struct inotify_event) + ((struct inotify_event*) p)->len) {
+                    auto *ev = (struct inotify_event*) p;
+                    if(ev->len == 0) continue;
+                    std::string dir;
+                    for(auto &d : dirs) {
+                        if(d.second == ev->wd) dir = d.first;
+                    }
+                    for(int slot = 0; slot < WATCH_COUNT; slot++) {
+                        for(auto &f : files[slot]) {
+                            if(f.dir != dir || f.name != ev->name) continue;
+                            settling |= 1u << slot;
+                            settle[slot] = now + std::chrono::milliseconds(WATCH_SETTLE_MS);
+                        }
+                    }
+                }
+            }
+        }
+        for(int slot = 0; slot < WATCH_COUNT; slot++) {
+            if(!(settling & (1u << slot)) || now < settle[slot]) continue;
+            settling &= ~(1u << slot);
+            changed |= 1u << slot;
+        }
+    }
+}
+
+#else
+
+FileWatcher::FileWatcher() {
+    changed = 0;
+}
+
+FileWatcher::~FileWatcher() {}
+
+void FileWatcher::Watch(int slot, const std::vector<std::string> &paths) {
+    (void) slot;
+    (void) paths;
+}
+
+uint32_t FileWatcher::Changed() {
+    return 0;
+}
+
+#endif
@@ -0,0 +1,46 @@
+#ifndef STAGE9_FILEWATCHER_H
+#define STAGE9_FILEWATCHER_H
+
+enum {
+    WATCH_PXM, WATCH_PXE, WATCH_TSC, WATCH_TILESET, WATCH_PXA, WATCH_NPC, WATCH_COUNT
+};
+
+// How long a file has to be left alone before a change is reported, editors tend
+// to write in several steps
+#define WATCH_SETTLE_MS 200
+
+// Notices when the files in each slot change on disk. The directories are watched rather
+// than the files, so a file replaced by a rename (like WriteFileAtomic does) is still seen.
+// Uses inotify on Linux, other platforms never report anything
+class FileWatcher {
+public:
+    FileWatcher();
+    ~FileWatcher();
+
+    // Replaces the files watched for a slot, an empty list stops watching it
+    void Watch(int slot, const std::vector<std::string> &paths);
+    // Bitmask of (1 << slot) for every slot that changed since the last call
+    uint32_t Changed();
+
+private:
+    typedef struct {
+        std::string dir, name;
+    } WatchedFile;
+
+    std::mutex mutex;
+    std::vector<WatchedFile> files[WATCH_COUNT];
+    uint32_t changed;
+#ifdef __linux__
+    int fd;
+    std::thread thread;
+    std::atomic<bool> quit;
+    std::map<std::string, int> dirs; // Directory to inotify watch descriptor
+    std::chrono::steady_clock::time_point settle[WATCH_COUNT];
+    uint32_t settling;
+
+    void UpdateDirs();
+    void Worker();
+#endif
+};
+
+#endif //STAGE9_FILEWATCHER_H
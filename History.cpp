@@ -3,6 +3,79 @@
 #include "PXE.h"
 #include "History.h"
 
+// Run length encoding, a control byte below 128 is followed by that many + 1 literal bytes,
+// otherwise the next byte is repeated (control - 125) times
+#define RLE_MIN_RUN 3
+#define RLE_MAX_RUN 130
+#define RLE_MAX_LIT 128
+
+static size_t PackRLE(const uint8_t *src, size_t n, uint8_t *dst) {
+    size_t i = 0, o = 0;
+    while(i < n) {
+        size_t run = 1;
+        while(i + run < n && run < RLE_MAX_RUN && src[i + run] == src[i]) run++;
+        if(run >= RLE_MIN_RUN) {
+            dst[o++] = run + 125;
+            dst[o++] = src[i];
+            i += run;
+            continue;
+        }
+        // Copy literals until the next run worth encoding
+        size_t start = i;
+        while(i < n && i - start < RLE_MAX_LIT) {
+            if(i + 2 < n && src[i] == src[i+1] && src[i] == src[i+2]) break;
+            i++;
+        }
+        dst[o++] = i - start - 1;
+        memcpy(&dst[o], &src[start], i - start);
+        o += i - start;
+    }
+    return o;
+}
+
+uint8_t* PackTileDelta(const uint8_t *old_tiles, const uint8_t *new_tiles, size_t count, uint32_t *packed_len) {
+    *packed_len = 0;
+    uint8_t *delta = (uint8_t*) malloc(count);
+    bool changed = false;
+    for(size_t i = 0; i < count; i++) {
+        delta[i] = old_tiles[i] ^ new_tiles[i];
+        if(delta[i]) changed = true;
+    }
+    if(!changed) {
+        free(delta);
+        return NULL;
+    }
+    // Worst case is all literals, one control byte per 128
+    uint8_t *packed = (uint8_t*) malloc(count + count / RLE_MAX_LIT + 1);
+    *packed_len = PackRLE(delta, count, packed);
+    free(delta);
+    return (uint8_t*) realloc(packed, *packed_len);
+}
+
+void UnpackTileDelta(const uint8_t *packed, uint32_t packed_len, uint8_t *out, size_t count) {
+    size_t o = 0;
+    for(uint32_t i = 0; i < packed_len && o < count;) {
+        uint8_t ctrl = packed[i++];
+        if(ctrl < RLE_MAX_LIT) {
+            size_t len = min((size_t) ctrl + 1, count - o);
+            memcpy(&out[o], &packed[i], len);
+            o += len;
+            i += ctrl + 1;
+        } else {
+            size_t len = min((size_t) ctrl - 125, count - o);
+            memset(&out[o], packed[i++], len);
+            o += len;
+        }
+    }
+    if(o < count) memset(&out[o], 0, count - o);
+}
+
+void FreeHistEntry(HistEntry *e) {
+    if(e->action == MAP_MOD) free(e->map_mod.delta);
+    if(e->action == MAP_SIZE) free(e->map_size.delta);
+    free(e);
+}
+
 History::History() {
 
 }
@@ -15,13 +88,15 @@ void History::AddEntry(HistEntry *entry) {
     ClearRedoList();
 }
 
+void History::AddUndone(HistEntry *entry) {
+    redoList.push_front(entry);
+}
+
 void History::ClearUndoList() {
     while(!undoList.empty()) {
         HistEntry *e = undoList.front();
         undoList.pop_front();
-        if(e->action == MAP_MOD) free(e->map_mod.old_data);
-        if(e->action == MAP_SIZE) free(e->map_size.old_data);
-        free(e);
+        FreeHistEntry(e);
     }
 }
 
@@ -29,9 +104,7 @@ void History::ClearRedoList() {
     while(!redoList.empty()) {
         HistEntry *e = redoList.front();
         redoList.pop_front();
-        if(e->action == MAP_MOD) free(e->map_mod.old_data);
-        if(e->action == MAP_SIZE) free(e->map_size.old_data);
-        free(e);
+        FreeHistEntry(e);
     }
 }
 
@@ -5,23 +5,35 @@ enum {
     MAP_MOD, MAP_SIZE, ENTITY_MOD, ENTITY_ADD, ENTITY_DEL
 };
 
+// Map payloads are the old tiles XOR'd against the tiles after the edit, run length encoded.
+// Unchanged tiles become zero and pack down to almost nothing, and since XOR is its own
+// inverse the same delta takes the map in either direction
 typedef struct {
     int action;
     union {
-        struct { uint16_t x, y, w, h, tx, ty, *old_data; } map_mod;
-        struct { uint16_t old_w, old_h, new_w, new_h, *old_data; } map_size;
-        struct { Entity old_entity, new_entity; } entity_mod;
+        struct { uint16_t x, y, w, h, tx, ty; uint32_t delta_len; uint8_t *delta; } map_mod;
+        struct { uint16_t old_w, old_h, new_w, new_h; uint32_t delta_len; uint8_t *delta; } map_size;
+        struct { Entity old_entity, new_entity; uint16_t index; } entity_mod;
         struct { Entity new_entity; } entity_add;
         struct { Entity old_entity; uint16_t index; } entity_del;
     };
 } HistEntry;
 
+void FreeHistEntry(HistEntry *e);
+
+// Returns a malloc'd packed delta between two tile buffers, or NULL if they are identical
+uint8_t* PackTileDelta(const uint8_t *old_tiles, const uint8_t *new_tiles, size_t count, uint32_t *packed_len);
+// Expands a packed delta back into count XOR bytes
+void UnpackTileDelta(const uint8_t *packed, uint32_t packed_len, uint8_t *out, size_t count);
+
 class History {
 public:
     History();
     ~History();
 
     void AddEntry(HistEntry *entry);
+    // Puts an entry that has already been undone on top of the redo list
+    void AddUndone(HistEntry *entry);
 
     void Clear();
     void ClearUndoList();
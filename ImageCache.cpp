@@ -0,0 +1,114 @@
+#include "common.h"
+
+#include "Preferences.h"
+#include "FileIO.h"
+#include "TextureLoader.h"
+#include "ImageCache.h"
+
+namespace fs = std::filesystem;
+
+ImageCache::ImageCache() : total_size(0), use_counter(0) {
+    dir = Preferences::Instance().DataPath() + "images/";
+    std::error_code ec;
+    fs::create_directories(dir, ec);
+    // Order what is already there by modification time, which is bumped on every hit
+    std::vector<std::pair<fs::file_time_type, std::string>> found;
+    for(auto &it : fs::directory_iterator(dir, ec)) {
+        if(it.path().extension() != ".rgba") continue;
+        uint64_t size = it.file_size(ec);
+        if(ec) continue;
+        found.push_back({ it.last_write_time(ec), it.path().filename().string() });
+        entries[found.back().second] = { size, 0 };
+        total_size += size;
+    }
+    std::sort(found.begin(), found.end());
+    for(auto &f : found) entries[f.second].last_used = ++use_counter;
+}
+
+bool ImageCache::Source(const std::string &fname, bool transparent, std::string &path, Header &header) {
+    std::error_code ec;
+    uint64_t size = fs::file_size(fname, ec);
+    if(ec) return false;
+    auto mtime = fs::last_write_time(fname, ec);
+    if(ec) return false;
+    uint8_t key = transparent;
+    uint32_t hash = HashBytes(&key, 1, HashBytes(fname.data(), fname.length()));
+    char name[16];
+    snprintf(name, sizeof(name), "%08x.rgba", hash);
+    path = name;
+    memcpy(header.magic, "DIC1", 4);
+    header.key_hash = HashBytes(&key, 1, HashBytes(fname.data(), fname.length(), 0x9E3779B9u));
+    header.w = header.h = 0;
+    header.src_size = size;
+    header.src_mtime = mtime.time_since_epoch().count();
+    return true;
+}
+
+bool ImageCache::Fetch(const std::string &fname, bool transparent, Image &img) {
+    std::string name;
+    Header want, have;
+    if(!Source(fname, transparent, name, want)) return false;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if(entries.find(name) == entries.end()) return false;
+    }
+    FILE *file = fopen((dir + name).c_str(), "rb");
+    if(!file) return false;
+    bool ok = fread(&have, sizeof(Header), 1, file) == 1
+            && memcmp(have.magic, want.magic, 4) == 0
+            && have.key_hash == want.key_hash
+            && have.src_size == want.src_size
+            && have.src_mtime == want.src_mtime
+            && have.w > 0 && have.h > 0 && have.w <= 0x4000 && have.h <= 0x4000;
+    if(ok) {
+        img.w = have.w;
+        img.h = have.h;
+        img.rgba.resize((size_t) have.w * have.h * 4);
+        ok = fread(img.rgba.data(), 1, img.rgba.size(), file) == img.rgba.size();
+    }
+    fclose(file);
+    if(!ok) {
+        img.w = img.h = 0;
+        img.rgba.clear();
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = entries.find(name);
+    if(it != entries.end()) it->second.last_used = ++use_counter;
+    // So the order survives a restart
+    std::error_code ec;
+    fs::last_write_time(dir + name, fs::file_time_type::clock::now(), ec);
+    return true;
+}
+
+void ImageCache::Store(const std::string &fname, bool transparent, const Image &img) {
+    std::string name;
+    Header header;
+    if(!Source(fname, transparent, name, header)) return;
+    header.w = img.w;
+    header.h = img.h;
+    std::vector<uint8_t> data(sizeof(Header) + img.rgba.size());
+    memcpy(data.data(), &header, sizeof(Header));
+    memcpy(data.data() + sizeof(Header), img.rgba.data(), img.rgba.size());
+    if(!WriteFileAtomic(dir + name, data.data(), data.size())) return;
+    std::lock_guard<std::mutex> lock(mutex);
+    Entry &e = entries[name];
+    total_size = total_size - e.size + data.size();
+    e.size = data.size();
+    e.last_used = ++use_counter;
+    Evict();
+}
+
+void ImageCache::Evict() {
+    if(total_size <= IMAGE_CACHE_LIMIT) return;
+    std::vector<std::pair<uint64_t, std::string>> order;
+    for(auto &it : entries) order.push_back({ it.second.last_used, it.first });
+    std::sort(order.begin(), order.end());
+    for(auto &o : order) {
+        if(total_size <= IMAGE_CACHE_LIMIT) break;
+        std::error_code ec;
+        fs::remove(dir + o.second, ec);
+        total_size -= entries[o.second].size;
+        entries.erase(o.second);
+    }
+}
@@ -0,0 +1,50 @@
+#ifndef STAGE9_IMAGECACHE_H
+#define STAGE9_IMAGECACHE_H
+
+// Total size of the decoded image cache on disk before old entries are evicted
+#define IMAGE_CACHE_LIMIT (256 * 1024 * 1024)
+
+// Decoded (and colour keyed) images are kept under the preferences path, one file each.
+// An entry is only used while the source file has the same size and modification time,
+// and the least recently used ones are removed once the cache outgrows IMAGE_CACHE_LIMIT.
+// Safe to use from any thread
+class ImageCache {
+public:
+    static ImageCache& Instance() {
+        static ImageCache instance;
+        return instance;
+    }
+    ImageCache(ImageCache const&) = delete;
+    void operator=(ImageCache const&)  = delete;
+
+    bool Fetch(const std::string &fname, bool transparent, Image &img);
+    void Store(const std::string &fname, bool transparent, const Image &img);
+
+private:
+    ImageCache();
+
+    // Pixels follow the header straight away, so an entry can be mapped and used in place
+    typedef struct {
+        char magic[4];
+        uint32_t key_hash; // Guards against two keys landing on the same file name
+        uint32_t w, h;
+        uint64_t src_size;
+        int64_t src_mtime;
+    } Header;
+
+    typedef struct {
+        uint64_t size;
+        uint64_t last_used;
+    } Entry;
+
+    std::string dir;
+    std::mutex mutex;
+    std::unordered_map<std::string, Entry> entries;
+    uint64_t total_size;
+    uint64_t use_counter;
+
+    bool Source(const std::string &fname, bool transparent, std::string &path, Header &header);
+    void Evict();
+};
+
+#endif //STAGE9_IMAGECACHE_H
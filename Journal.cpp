@@ -0,0 +1,271 @@
+#include "common.h"
+#ifdef _WIN32
+#include <io.h>
+#define fsync _commit
+#else
+#include <unistd.h>
+#endif
+
+#include "PXE.h"
+#include "Journal.h"
+
+#define JOURNAL_MAGIC "DEJ2"
+#define JOURNAL_HEAD_SIZE 8
+// How long the worker waits for more entries before writing, so one fsync covers a batch
+#define JOURNAL_BATCH_MS 250
+
+static void Put16(std::vector<uint8_t> &buf, uint16_t v) {
+    buf.push_back(v & 0xFF);
+    buf.push_back(v >> 8);
+}
+
+static void Put32(std::vector<uint8_t> &buf, uint32_t v) {
+    Put16(buf, v & 0xFFFF);
+    Put16(buf, v >> 16);
+}
+
+static void PutEntity(std::vector<uint8_t> &buf, const Entity &e) {
+    Put16(buf, e.x); Put16(buf, e.y); Put16(buf, e.id);
+    Put16(buf, e.event); Put16(buf, e.type); Put16(buf, e.flags);
+}
+
+static void PutEntry(std::vector<uint8_t> &buf, const HistEntry *e) {
+    buf.push_back(e->action);
+    switch(e->action) {
+        case MAP_MOD:
+            Put16(buf, e->map_mod.x); Put16(buf, e->map_mod.y);
+            Put16(buf, e->map_mod.w); Put16(buf, e->map_mod.h);
+            Put16(buf, e->map_mod.tx); Put16(buf, e->map_mod.ty);
+            Put32(buf, e->map_mod.delta_len);
+            buf.insert(buf.end(), e->map_mod.delta, e->map_mod.delta + e->map_mod.delta_len);
+            break;
+        case MAP_SIZE:
+            Put16(buf, e->map_size.old_w); Put16(buf, e->map_size.old_h);
+            Put16(buf, e->map_size.new_w); Put16(buf, e->map_size.new_h);
+            Put32(buf, e->map_size.delta_len);
+            buf.insert(buf.end(), e->map_size.delta, e->map_size.delta + e->map_size.delta_len);
+            break;
+        case ENTITY_MOD:
+            PutEntity(buf, e->entity_mod.old_entity);
+            PutEntity(buf, e->entity_mod.new_entity);
+            Put16(buf, e->entity_mod.index);
+            break;
+        case ENTITY_ADD:
+            PutEntity(buf, e->entity_add.new_entity);
+            break;
+        case ENTITY_DEL:
+            PutEntity(buf, e->entity_del.old_entity);
+            Put16(buf, e->entity_del.index);
+            break;
+    }
+}
+
+// Bounds checked reader for Load(), any read past the end marks the record as incomplete
+typedef struct {
+    const uint8_t *data;
+    size_t size, pos;
+    bool eof;
+} Reader;
+
+static uint8_t Get8(Reader &r) {
+    if(r.pos + 1 > r.size) { r.eof = true; return 0; }
+    return r.data[r.pos++];
+}
+
+static uint16_t Get16(Reader &r) {
+    uint16_t lo = Get8(r);
+    return lo | (Get8(r) << 8);
+}
+
+static uint32_t Get32(Reader &r) {
+    uint32_t lo = Get16(r);
+    return lo | ((uint32_t) Get16(r) << 16);
+}
+
+static Entity GetEntity(Reader &r) {
+    Entity e;
+    e.x = Get16(r); e.y = Get16(r); e.id = Get16(r);
+    e.event = Get16(r); e.type = Get16(r); e.flags = Get16(r);
+    return e;
+}
+
+static uint8_t* GetDelta(Reader &r, uint32_t len) {
+    if(r.eof || r.pos + len > r.size) { r.eof = true; return NULL; }
+    uint8_t *delta = (uint8_t*) malloc(len);
+    memcpy(delta, &r.data[r.pos], len);
+    r.pos += len;
+    return delta;
+}
+
+static HistEntry* GetEntry(Reader &r) {
+    HistEntry *e = (HistEntry*) calloc(1, sizeof(HistEntry));
+    e->action = Get8(r);
+    switch(e->action) {
+        case MAP_MOD:
+            e->map_mod.x = Get16(r); e->map_mod.y = Get16(r);
+            e->map_mod.w = Get16(r); e->map_mod.h = Get16(r);
+            e->map_mod.tx = Get16(r); e->map_mod.ty = Get16(r);
+            e->map_mod.delta_len = Get32(r);
+            e->map_mod.delta = GetDelta(r, e->map_mod.delta_len);
+            break;
+        case MAP_SIZE:
+            e->map_size.old_w = Get16(r); e->map_size.old_h = Get16(r);
+            e->map_size.new_w = Get16(r); e->map_size.new_h = Get16(r);
+            e->map_size.delta_len = Get32(r);
+            e->map_size.delta = GetDelta(r, e->map_size.delta_len);
+            break;
+        case ENTITY_MOD:
+            e->entity_mod.old_entity = GetEntity(r);
+            e->entity_mod.new_entity = GetEntity(r);
+            e->entity_mod.index = Get16(r);
+            break;
+        case ENTITY_ADD:
+            e->entity_add.new_entity = GetEntity(r);
+            break;
+        case ENTITY_DEL:
+            e->entity_del.old_entity = GetEntity(r);
+            e->entity_del.index = Get16(r);
+            break;
+        default:
+            r.eof = true;
+            break;
+    }
+    if(r.eof) {
+        FreeHistEntry(e);
+        return NULL;
+    }
+    return e;
+}
+
+Journal::Journal() {
+    quit = false;
+    thread = std::thread(&Journal::Worker, this);
+}
+
+Journal::~Journal() {
+    Close();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        quit = true;
+    }
+    cond.notify_one();
+    thread.join();
+}
+
+std::string Journal::PathFor(const std::string &map_fname) {
+    return map_fname + ".journal";
+}
+
+void Journal::Push(int type, const std::string &path, const uint8_t *data, size_t len) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if(type == OP_APPEND && !queue.empty() && queue.back().type == OP_APPEND) {
+            queue.back().data.insert(queue.back().data.end(), data, data + len);
+        } else {
+            queue.push_back({ type, path, std::vector<uint8_t>(data, data + len) });
+        }
+    }
+    cond.notify_one();
+}
+
+void Journal::Open(const std::string &map_fname, uint32_t base_hash) {
+    std::vector<uint8_t> head(JOURNAL_MAGIC, JOURNAL_MAGIC + 4);
+    Put32(head, base_hash);
+    Push(OP_OPEN, PathFor(map_fname), head.data(), head.size());
+}
+
+void Journal::Resume(const std::string &map_fname) {
+    Push(OP_RESUME, PathFor(map_fname), NULL, 0);
+}
+
+void Journal::Close() {
+    Push(OP_CLOSE, "", NULL, 0);
+}
+
+void Journal::Record(int op, const HistEntry *entry, uint32_t hash) {
+    std::vector<uint8_t> buf;
+    buf.push_back(op);
+    Put32(buf, hash);
+    if(op != JOURNAL_CLEAR) PutEntry(buf, entry);
+    Push(OP_APPEND, "", buf.data(), buf.size());
+}
+
+void Journal::Worker() {
+    FILE *file = NULL;
+    std::string path;
+    bool empty = true;
+    std::unique_lock<std::mutex> lock(mutex);
+    while(true) {
+        cond.wait(lock, [this] { return quit || !queue.empty(); });
+        if(queue.empty()) break;
+        cond.wait_for(lock, std::chrono::milliseconds(JOURNAL_BATCH_MS), [this] { return quit; });
+        std::vector<Op> ops;
+        ops.swap(queue);
+        lock.unlock();
+        bool written = false;
+        for(auto &op : ops) {
+            if(op.type != OP_APPEND && file) {
+                if(written) fsync(fileno(file));
+                written = false;
+                fclose(file);
+                file = NULL;
+                if(empty) remove(path.c_str());
+            }
+            switch(op.type) {
+                case OP_OPEN:
+                    path = op.path;
+                    file = fopen(path.c_str(), "wb");
+                    if(file) fwrite(op.data.data(), 1, op.data.size(), file);
+                    empty = true;
+                    written = true;
+                    break;
+                case OP_RESUME:
+                    path = op.path;
+                    file = fopen(path.c_str(), "ab");
+                    empty = false;
+                    break;
+                case OP_APPEND:
+                    if(file) {
+                        fwrite(op.data.data(), 1, op.data.size(), file);
+                        empty = false;
+                        written = true;
+                    }
+                    break;
+            }
+            if(op.type != OP_APPEND && op.type != OP_CLOSE && !file) {
+                printf("Failed to open journal %s\n", path.c_str());
+            }
+        }
+        if(file && written) {
+            fflush(file);
+            fsync(fileno(file));
+        }
+        lock.lock();
+    }
+}
+
+bool Journal::Load(const std::string &map_fname, uint32_t *base_hash, std::vector<JournalRecord> &records) {
+    FILE *file = fopen(PathFor(map_fname).c_str(), "rb");
+    if(!file) return false;
+    fseek(file, 0, SEEK_END);
+    size_t size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    std::vector<uint8_t> data(size);
+    size = fread(data.data(), 1, size, file);
+    fclose(file);
+    if(size <= JOURNAL_HEAD_SIZE || memcmp(data.data(), JOURNAL_MAGIC, 4) != 0) return false;
+    Reader r = { data.data(), size, 4, false };
+    *base_hash = Get32(r);
+    while(r.pos < r.size) {
+        JournalRecord rec = { Get8(r), NULL, 0 };
+        if(rec.op > JOURNAL_APPLY) break;
+        rec.hash = Get32(r);
+        if(r.eof) break;
+        if(rec.op != JOURNAL_CLEAR) {
+            rec.entry = GetEntry(r);
+            if(!rec.entry) break;
+        }
+        records.push_back(rec);
+    }
+    return !records.empty();
+}
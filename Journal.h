@@ -0,0 +1,57 @@
+#ifndef STAGE9_JOURNAL_H
+#define STAGE9_JOURNAL_H
+
+#include "History.h"
+
+enum {
+    JOURNAL_ADD, JOURNAL_UNDO, JOURNAL_REDO, JOURNAL_CLEAR,
+    JOURNAL_APPLY // Changes the map without going in the history, like edits older than the journal
+};
+
+// Undo and redo carry the entry too: after a save the journal starts over, but the history
+// doesn't, so replaying has to be able to undo entries it never saw added
+typedef struct {
+    int op;
+    HistEntry *entry; // All but JOURNAL_CLEAR, owned by whoever reads the journal
+    uint32_t hash;    // Of the map after the record, to check a replay against
+} JournalRecord;
+
+// Append-only log of history operations kept next to the map, so unsaved edits can be
+// replayed on top of the file on disk after a crash. All file access happens on a
+// background thread, Record() only copies the entry into a queue
+class Journal {
+public:
+    Journal();
+    ~Journal();
+
+    // Starts a fresh journal for the map, base_hash identifies the map state it applies to
+    void Open(const std::string &map_fname, uint32_t base_hash);
+    // Keeps appending to an existing journal after it has been replayed
+    void Resume(const std::string &map_fname);
+    // Stops journaling, the file is removed if nothing was recorded
+    void Close();
+    void Record(int op, const HistEntry *entry, uint32_t hash);
+
+    static std::string PathFor(const std::string &map_fname);
+    // Reads a journal, a record cut off by a crash ends the list. Returns false if there is nothing to replay
+    static bool Load(const std::string &map_fname, uint32_t *base_hash, std::vector<JournalRecord> &records);
+
+private:
+    enum { OP_OPEN, OP_RESUME, OP_APPEND, OP_CLOSE };
+    typedef struct {
+        int type;
+        std::string path;
+        std::vector<uint8_t> data;
+    } Op;
+
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable cond;
+    std::vector<Op> queue;
+    bool quit;
+
+    void Push(int type, const std::string &path, const uint8_t *data, size_t len);
+    void Worker();
+};
+
+#endif //STAGE9_JOURNAL_H
@@ -0,0 +1,245 @@
+#include "common.h"
+
+#include "ThreadPool.h"
+#include "pxm.h"
+#include "PXE.h"
+#include "Project.h"
+#include "TileRender.h"
+#include "PngWriter.h"
+#include "MapExport.h"
+
+namespace fs = std::filesystem;
+
+#define EXPORT_BACKGROUND 0xFF000000u
+// Same green as entities in the editor
+#define EXPORT_ENTITY_COLOR 0x7700FF00u
+#define EXPORT_ATTR_COUNT 256
+
+typedef struct {
+    bool entities, attributes;
+} ExportOptions;
+
+typedef struct {
+    std::string error; // Empty if it was written
+    bool skipped;
+} ExportResult;
+
+// Tile sheets and attributes of each tileset, made by whichever stage needs them first
+typedef struct {
+    std::shared_ptr<const TileSheet> sheet;
+    uint8_t attr[EXPORT_ATTR_COUNT];
+} ExportTileset;
+
+static std::mutex tilesets_mutex;
+static std::unordered_map<std::string, std::shared_ptr<const ExportTileset>> tilesets;
+
+static void ExportUsage() {
+    printf("Usage: DoukutsuEdit --export-png <data dir> [out dir] [options]\n"
+           "  Writes <out dir>/<map>.png for every stage (out dir defaults to export)\n"
+           "  --entities       Mark entities like the editor does\n"
+           "  --attributes     Tint tiles by their attribute (solid, water, slope...)\n"
+           "  --memory MB      Memory for stages in flight (default %u)\n",
+           EXPORT_MEMORY_BUDGET / (1024 * 1024));
+}
+
+static std::shared_ptr<const ExportTileset> GetTileset(const std::string &fname) {
+    {
+        std::lock_guard<std::mutex> lock(tilesets_mutex);
+        auto it = tilesets.find(fname);
+        if(it != tilesets.end()) return it->second;
+    }
+    Image img;
+    if(!TextureLoader::Decode(fname, true, img)) return NULL;
+    auto ts = std::make_shared<ExportTileset>();
+    auto sheet = std::make_shared<TileSheet>();
+    MakeTileSheet(img, TILE_SIZE, *sheet);
+    ts->sheet = sheet;
+    memset(ts->attr, 0, sizeof(ts->attr));
+    std::string pxa = fname.substr(0, fname.find_last_of('.')) + ".pxa";
+    FILE *file = fopen(pxa.c_str(), "rb");
+    if(file) {
+        fread(ts->attr, 1, sizeof(ts->attr), file);
+        fclose(file);
+    }
+    // Two stages may have made it at once, they come out the same
+    std::lock_guard<std::mutex> lock(tilesets_mutex);
+    return tilesets.insert({ fname, ts }).first->second;
+}
+
+static inline uint32_t Blend(uint32_t dst, uint32_t src) {
+    uint32_t a = src >> 24, out = 0xFF000000u;
+    for(int c = 0; c < 24; c += 8) {
+        uint32_t s = (src >> c) & 0xFF, d = (dst >> c) & 0xFF;
+        out |= ((s * a + d * (255 - a) + 127) / 255) << c;
+    }
+    return out;
+}
+
+static void FillTile(Image &img, int tx, int ty, uint32_t color) {
+    if(tx < 0 || ty < 0 || (tx + 1) * TILE_SIZE > img.w || (ty + 1) * TILE_SIZE > img.h) return;
+    auto pixels = (uint32_t*) img.rgba.data();
+    for(int y = 0; y < TILE_SIZE; y++) {
+        uint32_t *row = pixels + (size_t) (ty * TILE_SIZE + y) * img.w + tx * TILE_SIZE;
+        for(int x = 0; x < TILE_SIZE; x++) row[x] = Blend(row[x], color);
+    }
+}
+
+// Same meaning as the Tile Attributes panel of the editor
+static uint32_t AttributeColor(uint8_t attr) {
+    if(attr & 0x80) return 0x80FFFF00u; // Wind
+    if(attr & 0x10) return 0x8000FFFFu; // Slope
+    if(attr & 0x20) return 0x80FF6000u; // Water
+    switch(attr & 7) {
+        case 1: return 0x80FFFFFFu; // Solid
+        case 2: return 0x800000FFu; // Damage
+        case 3: return 0x800080FFu; // Breakable
+        case 4: return 0x80FF00C0u; // NPC solid
+        case 5: return 0x8000C000u; // Bullet pass
+        case 6: return 0x80C08000u; // Player solid
+        default: return 0;
+    }
+}
+
+static ExportResult ExportStage(const ProjectStage &stage, const std::string &out_dir, const ExportOptions &options) {
+    ExportResult result = { "", false };
+    const std::string &tileset_fname = stage.files[PROJECT_TILESET].path;
+    if(tileset_fname.empty()) {
+        result.skipped = true;
+        return result;
+    }
+    auto tileset = GetTileset(tileset_fname);
+    if(!tileset) {
+        result.error = "couldn't read " + tileset_fname;
+        return result;
+    }
+    FILE *file = fopen(stage.files[PROJECT_PXM].path.c_str(), "rb");
+    if(!file) {
+        result.error = "couldn't read " + stage.files[PROJECT_PXM].path;
+        return result;
+    }
+    PXM pxm;
+    pxm.Load(file);
+    fclose(file);
+    // A truncated or corrupt map loads as 0x0, which PNG can't hold
+    if(pxm.Width() == 0 || pxm.Height() == 0) {
+        result.error = "couldn't read " + stage.files[PROJECT_PXM].path;
+        return result;
+    }
+    Image img;
+    RenderMap(pxm, *tileset->sheet, EXPORT_BACKGROUND, img);
+    if(options.attributes) {
+        for(int y = 0; y < pxm.Height(); y++) {
+            for(int x = 0; x < pxm.Width(); x++) {
+                uint32_t color = AttributeColor(tileset->attr[pxm.Tile(x, y)]);
+                if(color) FillTile(img, x, y, color);
+            }
+        }
+    }
+    if(options.entities && !stage.files[PROJECT_PXE].path.empty()) {
+        file = fopen(stage.files[PROJECT_PXE].path.c_str(), "rb");
+        if(file) {
+            PXE pxe;
+            pxe.Load(file);
+            fclose(file);
+            for(int i = 0; i < pxe.Size(); i++) {
+                Entity e = pxe.GetEntity(i);
+                FillTile(img, e.x, e.y, EXPORT_ENTITY_COLOR);
+            }
+        }
+    }
+    std::string error;
+    if(!WritePng((fs::path(out_dir) / (stage.name + ".png")).string(), img, &error)) result.error = error;
+    return result;
+}
+
+int ExportMain(int argc, char *argv[]) {
+    if(argc < 1) {
+        ExportUsage();
+        return 2;
+    }
+    std::string dir = argv[0], out_dir = "export";
+    ExportOptions options = { false, false };
+    size_t budget = EXPORT_MEMORY_BUDGET;
+    for(int i = 1; i < argc; i++) {
+        std::string opt = argv[i];
+        if(opt == "--entities") {
+            options.entities = true;
+        } else if(opt == "--attributes") {
+            options.attributes = true;
+        } else if(opt == "--memory" && i + 1 < argc) {
+            int mb = atoi(argv[++i]);
+            budget = (size_t) max(1, mb) * 1024 * 1024;
+        } else if(i == 1 && opt.rfind("--", 0) != 0) {
+            out_dir = opt;
+        } else {
+            ExportUsage();
+            return 2;
+        }
+    }
+    auto started = std::chrono::steady_clock::now();
+    Project project;
+    project.Open(dir);
+    while(project.Loading()) {
+        ThreadPool::Instance().Pump();
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    const std::vector<ProjectStage> &stages = project.Stages();
+    if(stages.empty()) {
+        printf("No stages in %s\n", dir.c_str());
+        return 1;
+    }
+    std::error_code ec;
+    fs::create_directories(out_dir, ec);
+    if(ec) {
+        printf("Couldn't create %s: %s\n", out_dir.c_str(), ec.message().c_str());
+        return 1;
+    }
+
+    // A stage is only started once its image and PNG fit in what the running ones left over
+    std::vector<ExportResult> results(stages.size());
+    std::mutex mutex;
+    std::condition_variable cond;
+    size_t in_use = 0;
+    int running = 0;
+    for(size_t i = 0; i < stages.size(); i++) {
+        const ProjectStage &s = stages[i];
+        // The image and the encoder's copy of its scanlines, the compressed file is small next to them
+        size_t need = (size_t) s.width * s.height * TILE_SIZE * TILE_SIZE * 4 * 2;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            cond.wait(lock, [&]() { return running == 0 || in_use + need <= budget; });
+            in_use += need;
+            running++;
+        }
+        ThreadPool::Instance().Submit([&, i, need]() {
+            ExportResult r = ExportStage(stages[i], out_dir, options);
+            std::lock_guard<std::mutex> lock(mutex);
+            results[i] = r;
+            in_use -= need;
+            running--;
+            cond.notify_all();
+        });
+    }
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        cond.wait(lock, [&]() { return running == 0; });
+    }
+
+    // Reported in stage order, so the output is the same every run too
+    int written = 0, skipped = 0, failed = 0;
+    for(size_t i = 0; i < stages.size(); i++) {
+        if(results[i].skipped) {
+            printf("%s: skipped, no tileset\n", stages[i].name.c_str());
+            skipped++;
+        } else if(!results[i].error.empty()) {
+            printf("%s: %s\n", stages[i].name.c_str(), results[i].error.c_str());
+            failed++;
+        } else {
+            written++;
+        }
+    }
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - started).count();
+    printf("Wrote %d of %d stages to %s (%d skipped, %d failed) in %.0f ms\n", written, (int) stages.size(),
+           out_dir.c_str(), skipped, failed, ms);
+    return failed > 0 ? 1 : 0;
+}
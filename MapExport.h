@@ -0,0 +1,10 @@
+#ifndef STAGE9_MAPEXPORT_H
+#define STAGE9_MAPEXPORT_H
+
+// Peak memory of the stages being exported at once, unless a single one needs more
+#define EXPORT_MEMORY_BUDGET (512u * 1024 * 1024)
+
+// --export-png command line, returns the exit code
+int ExportMain(int argc, char *argv[]);
+
+#endif //STAGE9_MAPEXPORT_H
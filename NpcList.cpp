@@ -0,0 +1,203 @@
+#include "common.h"
+
+#include "NpcList.h"
+
+// Only as much of C as the three files need: identifiers, numbers, strings and single
+// character punctuation. Comments and preprocessor lines are skipped
+enum { TOK_END, TOK_IDENT, TOK_NUMBER, TOK_STRING, TOK_PUNCT, TOK_NEWLINE };
+
+typedef struct {
+    int type;
+    std::string_view text;
+} Token;
+
+typedef struct {
+    const char *p, *end;
+    bool newlines; // Emit TOK_NEWLINE, for the line based resources.res
+    bool line_start;
+} Lexer;
+
+typedef struct {
+    std::string_view path;
+    int w, h;
+} SpriteRes;
+
+static Lexer MakeLexer(const std::string &src, bool newlines) {
+    return { src.data(), src.data() + src.size(), newlines, true };
+}
+
+static Token NextToken(Lexer &lx) {
+    while(lx.p < lx.end) {
+        const char *s = lx.p;
+        char c = *s;
+        if(c == '\n') {
+            lx.p++;
+            lx.line_start = true;
+            if(lx.newlines) return { TOK_NEWLINE, std::string_view(s, 1) };
+        } else if(isspace((uint8_t) c)) {
+            lx.p++;
+        } else if(c == '/' && lx.p + 1 < lx.end && lx.p[1] == '/') {
+            while(lx.p < lx.end && *lx.p != '\n') lx.p++;
+        } else if(c == '/' && lx.p + 1 < lx.end && lx.p[1] == '*') {
+            lx.p += 2;
+            while(lx.p + 1 < lx.end && !(lx.p[0] == '*' && lx.p[1] == '/')) lx.p++;
+            lx.p = min(lx.p + 2, lx.end);
+        } else if(c == '#' && lx.line_start) {
+            // Preprocessor line, including any continuations
+            while(lx.p < lx.end && *lx.p != '\n') {
+                if(*lx.p == '\\' && lx.p + 1 < lx.end) lx.p++;
+                lx.p++;
+            }
+        } else {
+            lx.line_start = false;
+            if(isalpha((uint8_t) c) || c == '_') {
+                while(lx.p < lx.end && (isalnum((uint8_t) *lx.p) || *lx.p == '_')) lx.p++;
+                return { TOK_IDENT, std::string_view(s, lx.p - s) };
+            }
+            if(isdigit((uint8_t) c)) {
+                while(lx.p < lx.end && isalnum((uint8_t) *lx.p)) lx.p++;
+                return { TOK_NUMBER, std::string_view(s, lx.p - s) };
+            }
+            if(c == '"') {
+                lx.p++;
+                while(lx.p < lx.end && *lx.p != '"' && *lx.p != '\n') {
+                    if(*lx.p == '\\' && lx.p + 1 < lx.end) lx.p++;
+                    lx.p++;
+                }
+                Token t = { TOK_STRING, std::string_view(s + 1, lx.p - s - 1) };
+                if(lx.p < lx.end && *lx.p == '"') lx.p++;
+                return t;
+            }
+            lx.p++;
+            return { TOK_PUNCT, std::string_view(s, 1) };
+        }
+    }
+    return { TOK_END, {} };
+}
+
+static bool StartsWith(std::string_view text, const char *prefix) {
+    return text.compare(0, strlen(prefix), prefix) == 0;
+}
+
+static bool IsPunct(const Token &t, char c) {
+    return t.type == TOK_PUNCT && t.text[0] == c;
+}
+
+static bool SlurpFile(const std::string &path, std::string &out) {
+    FILE *file = fopen(path.c_str(), "rb");
+    if(!file) return false;
+    char buf[0x4000];
+    size_t len;
+    out.clear();
+    while((len = fread(buf, 1, sizeof(buf), file)) > 0) out.append(buf, len);
+    fclose(file);
+    return true;
+}
+
+// Tracks the first SHEET_ name and &SPR_ variable mentioned between two delimiters.
+// A SHEET_ identifier followed by '(' is a macro like SHEET_ADD rather than a sheet
+typedef struct {
+    std::string_view sheet, spr, maybe_sheet;
+    bool amp;
+} Mentions;
+
+static void Mention(Mentions &m, const Token &t) {
+    if(!m.maybe_sheet.empty() && !IsPunct(t, '(') && m.sheet.empty()) m.sheet = m.maybe_sheet;
+    m.maybe_sheet = {};
+    if(t.type == TOK_IDENT) {
+        if(StartsWith(t.text, "SHEET_")) m.maybe_sheet = t.text;
+        else if(m.amp && m.spr.empty() && StartsWith(t.text, "SPR_")) m.spr = t.text;
+    }
+    m.amp = IsPunct(t, '&');
+}
+
+// sheet.c: ADD_SHEET(SHEET_X, &SPR_X, ...); and the like, one statement per sheet
+static void ParseSheets(const std::string &src, std::unordered_map<std::string_view, std::string_view> &sheets) {
+    Lexer lx = MakeLexer(src, false);
+    Mentions m = {};
+    for(Token t = NextToken(lx); t.type != TOK_END; t = NextToken(lx)) {
+        if(IsPunct(t, ';') || IsPunct(t, '{') || IsPunct(t, '}')) {
+            Mention(m, t);
+            if(!m.sheet.empty() && !m.spr.empty()) sheets.emplace(m.sheet, m.spr);
+            m = {};
+            continue;
+        }
+        Mention(m, t);
+    }
+}
+
+// resources.res: SPRITE SPR_X "path.png" w h ..., one per line
+static void ParseResources(const std::string &src, std::unordered_map<std::string_view, SpriteRes> &res) {
+    Lexer lx = MakeLexer(src, true);
+    Token line[5];
+    int count = 0;
+    for(Token t = NextToken(lx);; t = NextToken(lx)) {
+        if(t.type == TOK_NEWLINE || t.type == TOK_END) {
+            if(count == 5 && line[0].type == TOK_IDENT && line[1].type == TOK_IDENT && line[2].type == TOK_STRING
+                    && line[3].type == TOK_NUMBER && line[4].type == TOK_NUMBER) {
+                int w = (int) strtol(line[3].text.data(), NULL, 0);
+                int h = (int) strtol(line[4].text.data(), NULL, 0);
+                res.emplace(line[1].text, SpriteRes { line[2].text, w, h });
+            }
+            if(t.type == TOK_END) break;
+            count = 0;
+            continue;
+        }
+        if(count < 5) line[count++] = t;
+    }
+}
+
+std::vector<std::string> NpcListSources(const std::string &fname) {
+    std::string root = fname.substr(0, fname.find("/src/db/npc.c"));
+    return { fname, root + "/src/sheet.c", root + "/res/resources.res" };
+}
+
+bool ParseNpcList(const std::string &fname, std::vector<NpcSprite> &sprites) {
+    std::string npc_str, sheet_str, res_str;
+    if(!SlurpFile(fname, npc_str)) return false;
+    std::string root = fname.substr(0, fname.find("/src/db/npc.c"));
+    SlurpFile(root + "/src/sheet.c", sheet_str);
+    SlurpFile(root + "/res/resources.res", res_str);
+    // Keys point into the strings above
+    std::unordered_map<std::string_view, std::string_view> sheets;
+    std::unordered_map<std::string_view, SpriteRes> res;
+    ParseSheets(sheet_str, sheets);
+    ParseResources(res_str, res);
+
+    // The table is the first initializer list, each NPC is a brace group inside it
+    // and may be spread over as many lines as it likes
+    Lexer lx = MakeLexer(npc_str, false);
+    Mentions m = {};
+    int depth = 0;
+    bool table = false, after_eq = false;
+    for(Token t = NextToken(lx); t.type != TOK_END; t = NextToken(lx)) {
+        if(IsPunct(t, '{')) {
+            depth++;
+            if(depth == 1) table = after_eq;
+            else if(depth == 2) m = {};
+        } else if(IsPunct(t, '}')) {
+            if(depth == 2 && table) {
+                Mention(m, t);
+                std::string_view spr = m.spr;
+                if(spr.empty() && !m.sheet.empty()) {
+                    auto sheet = sheets.find(m.sheet);
+                    if(sheet != sheets.end()) spr = sheet->second;
+                }
+                NpcSprite sprite = {};
+                auto r = spr.empty() ? res.end() : res.find(spr);
+                if(r != res.end() && r->second.w > 0 && r->second.h > 0) {
+                    sprite.fname = root + "/res/" + std::string(r->second.path);
+                    sprite.frame_w = r->second.w;
+                    sprite.frame_h = r->second.h;
+                }
+                sprites.emplace_back(sprite);
+            }
+            if(depth == 1 && table) break;
+            if(depth > 0) depth--;
+        } else if(depth >= 2) {
+            Mention(m, t);
+        }
+        after_eq = IsPunct(t, '=');
+    }
+    return true;
+}
@@ -0,0 +1,18 @@
+#ifndef STAGE9_NPCLIST_H
+#define STAGE9_NPCLIST_H
+
+typedef struct {
+    std::string fname;
+    uint32_t texture;
+    int tex_w, tex_h;
+    int frame_w, frame_h;
+} NpcSprite;
+
+// Reads the NPC table from src/db/npc.c and finds each NPC's sprite through src/sheet.c and
+// res/resources.res next to it. Every NPC gets an entry in sprites, with an empty fname when
+// it has no sprite. Returns false if npc.c couldn't be read
+bool ParseNpcList(const std::string &fname, std::vector<NpcSprite> &sprites);
+// npc.c and the other files ParseNpcList reads
+std::vector<std::string> NpcListSources(const std::string &fname);
+
+#endif //STAGE9_NPCLIST_H
@@ -28,6 +28,13 @@ void PXE::AddEntity(Entity e) {
     memcpy(&entities[size - 1], &e, sizeof(Entity));
 }
 
+void PXE::InsertEntity(uint16_t index, Entity e) {
+    if(index > size) index = size;
+    Resize(size + 1);
+    for(uint16_t i = size - 1; i > index; i--) entities[i] = entities[i-1];
+    entities[index] = e;
+}
+
 void PXE::DeleteEntity(uint16_t index) {
     for(uint16_t i = index; i < size - 1; i++) entities[i] = entities[i+1];
     Resize(size - 1);
@@ -53,10 +60,17 @@ void PXE::Load(FILE *file) {
     //}
 }
 
-void PXE::Save(FILE *file) {
+void PXE::Save(FILE *file) const {
+    std::vector<uint8_t> buf;
+    Save(buf);
+    fwrite(buf.data(), 1, buf.size(), file);
+}
+
+void PXE::Save(std::vector<uint8_t> &buf) const {
     static const char head[4] = "PXE";
-    fwrite(head, 1, 4, file);
-    fwrite(&size, 2, 1, file);
-    fwrite(&size, 2, 1, file); // skip 2 bytes
-    fwrite(entities, 2, size * 6, file);
+    buf.resize(8 + size * sizeof(Entity));
+    memcpy(&buf[0], head, 4);
+    memcpy(&buf[4], &size, 2);
+    memcpy(&buf[6], &size, 2); // skip 2 bytes
+    memcpy(&buf[8], entities, size * sizeof(Entity));
 }
@@ -11,18 +11,35 @@ public:
         entities = NULL;
         Clear();
     }
+    PXE(const PXE &other) {
+        entities = NULL;
+        *this = other;
+    }
     ~PXE() { free(entities); }
+    PXE& operator=(const PXE &other) {
+        if(this != &other) {
+            Resize(other.size);
+            memcpy(entities, other.entities, size * sizeof(Entity));
+        }
+        return *this;
+    }
     uint16_t Size() const { return size; }
-    Entity GetEntity(uint16_t i) { return i < size ? entities[i] : Entity(); }
+    Entity GetEntity(uint16_t i) const { return i < size ? entities[i] : Entity(); }
     int FindEntity(uint16_t x, uint16_t y);
+    uint32_t Hash() const { return HashBytes(entities, size * sizeof(Entity)); }
+    bool Equals(const PXE &other) const {
+        return size == other.size && memcmp(entities, other.entities, size * sizeof(Entity)) == 0;
+    }
 
     void SetEntity(uint16_t i, Entity e);
     void Resize(uint16_t _size);
     void AddEntity(Entity e);
+    void InsertEntity(uint16_t index, Entity e);
     void DeleteEntity(uint16_t index);
     void Clear();
     void Load(FILE *file);
-    void Save(FILE *file);
+    void Save(FILE *file) const;
+    void Save(std::vector<uint8_t> &buf) const;
 private:
     uint16_t size;
     Entity *entities;
@@ -0,0 +1,245 @@
+#include "common.h"
+
+#include "FileIO.h"
+#include "PngWriter.h"
+
+// Deflate's limits, and how hard the match finder looks. Candidates past the chain limit
+// are skipped, so a long run of repeats stays linear
+#define DEFLATE_WINDOW 32768
+#define DEFLATE_MIN_MATCH 3
+#define DEFLATE_MAX_MATCH 258
+#define DEFLATE_HASH_BITS 15
+#define DEFLATE_CHAIN_LIMIT 16
+
+typedef struct {
+    uint32_t table[8][256];
+} CrcTables;
+
+static CrcTables MakeCrcTables() {
+    CrcTables t;
+    for(uint32_t i = 0; i < 256; i++) {
+        uint32_t c = i;
+        for(int k = 0; k < 8; k++) c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+        t.table[0][i] = c;
+    }
+    // Slicing by 8, table n is the crc of a byte followed by n zeros
+    for(uint32_t i = 0; i < 256; i++) {
+        for(int n = 1; n < 8; n++) t.table[n][i] = (t.table[n - 1][i] >> 8) ^ t.table[0][t.table[n - 1][i] & 0xFF];
+    }
+    return t;
+}
+
+uint32_t Crc32(const uint8_t *data, size_t len, uint32_t crc) {
+    static const CrcTables t = MakeCrcTables();
+    crc = ~crc;
+    for(; len >= 8; data += 8, len -= 8) {
+        uint32_t a = crc ^ (data[0] | (data[1] << 8) | (data[2] << 16) | ((uint32_t) data[3] << 24));
+        crc = t.table[7][a & 0xFF] ^ t.table[6][(a >> 8) & 0xFF] ^ t.table[5][(a >> 16) & 0xFF] ^ t.table[4][a >> 24]
+            ^ t.table[3][data[4]] ^ t.table[2][data[5]] ^ t.table[1][data[6]] ^ t.table[0][data[7]];
+    }
+    while(len--) crc = t.table[0][(crc ^ *data++) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+uint32_t Adler32(const uint8_t *data, size_t len, uint32_t adler) {
+    uint32_t a = adler & 0xFFFF, b = adler >> 16;
+    while(len > 0) {
+        // Largest run that can't overflow b before taking the modulo
+        size_t n = min(len, (size_t) 5552);
+        len -= n;
+        while(n--) {
+            a += *data++;
+            b += a;
+        }
+        a %= 65521;
+        b %= 65521;
+    }
+    return (b << 16) | a;
+}
+
+// Length and distance codes, from the deflate spec (RFC 1951 3.2.5)
+static const uint16_t length_base[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+                                          35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+static const uint8_t length_extra[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+                                          3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+static const uint16_t dist_base[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385,
+                                        513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+static const uint8_t dist_extra[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7,
+                                        8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+// Deflate packs bits from the lowest up, Huffman codes go in reversed (top bit first)
+typedef struct {
+    std::vector<uint8_t> *out;
+    uint32_t bits;
+    int count;
+} BitWriter;
+
+static void PutBits(BitWriter &w, uint32_t value, int n) {
+    w.bits |= value << w.count;
+    w.count += n;
+    while(w.count >= 8) {
+        w.out->push_back(w.bits & 0xFF);
+        w.bits >>= 8;
+        w.count -= 8;
+    }
+}
+
+static uint32_t Reverse(uint32_t code, int n) {
+    uint32_t reversed = 0;
+    for(int i = 0; i < n; i++) reversed |= ((code >> i) & 1) << (n - 1 - i);
+    return reversed;
+}
+
+// Fixed Huffman codes of the literal/length symbols, already reversed
+typedef struct {
+    uint16_t code[288];
+    uint8_t len[288];
+} FixedCodes;
+
+static FixedCodes MakeFixedCodes() {
+    FixedCodes c;
+    for(int sym = 0; sym < 288; sym++) {
+        uint32_t code;
+        int n;
+        if(sym < 144) { code = 0x30 + sym; n = 8; }
+        else if(sym < 256) { code = 0x190 + sym - 144; n = 9; }
+        else if(sym < 280) { code = sym - 256; n = 7; }
+        else { code = 0xC0 + sym - 280; n = 8; }
+        c.code[sym] = Reverse(code, n);
+        c.len[sym] = n;
+    }
+    return c;
+}
+
+static void PutSymbol(BitWriter &w, int sym) {
+    static const FixedCodes c = MakeFixedCodes();
+    PutBits(w, c.code[sym], c.len[sym]);
+}
+
+static void PutMatch(BitWriter &w, int len, int dist) {
+    int l = 28;
+    while(length_base[l] > len) l--;
+    PutSymbol(w, 257 + l);
+    PutBits(w, len - length_base[l], length_extra[l]);
+    int d = 29;
+    while(dist_base[d] > dist) d--;
+    PutBits(w, Reverse(d, 5), 5);
+    PutBits(w, dist - dist_base[d], dist_extra[d]);
+}
+
+static uint32_t Hash3(const uint8_t *p) {
+    return ((p[0] | (p[1] << 8) | (p[2] << 16)) * 2654435761u) >> (32 - DEFLATE_HASH_BITS);
+}
+
+// Bytes a and b have in common, up to limit, a word at a time
+static int MatchLength(const uint8_t *a, const uint8_t *b, int limit) {
+    int n = 0;
+    for(; n + 8 <= limit; n += 8) {
+        uint64_t x, y;
+        memcpy(&x, a + n, 8);
+        memcpy(&y, b + n, 8);
+        if(x != y) break;
+    }
+    while(n < limit && a[n] == b[n]) n++;
+    return n;
+}
+
+// One fixed Huffman block with greedy LZ77 matches. Far from zlib's best, but map renders are
+// rows of repeated tiles, which short chains find, and the output only depends on the input
+static void Deflate(const uint8_t *data, size_t len, std::vector<uint8_t> &out) {
+    BitWriter w = { &out, 0, 0 };
+    PutBits(w, 1, 1); // BFINAL
+    PutBits(w, 1, 2); // BTYPE 01, fixed codes
+    std::vector<int32_t> head(1 << DEFLATE_HASH_BITS, -1), prev(DEFLATE_WINDOW, -1);
+    auto insert = [&](size_t at) {
+        uint32_t h = Hash3(data + at);
+        prev[at & (DEFLATE_WINDOW - 1)] = head[h];
+        head[h] = (int32_t) at;
+    };
+    size_t i = 0;
+    while(i < len) {
+        int best_len = 0, best_dist = 0;
+        if(i + DEFLATE_MIN_MATCH <= len) {
+            int limit = (int) min(len - i, (size_t) DEFLATE_MAX_MATCH);
+            int32_t cand = head[Hash3(data + i)];
+            for(int chain = 0; cand >= 0 && chain < DEFLATE_CHAIN_LIMIT; chain++) {
+                size_t dist = i - cand;
+                if(dist > DEFLATE_WINDOW) break;
+                // Has to beat the best so far at its last byte before it's worth comparing the rest
+                if(data[cand + best_len] == data[i + best_len]) {
+                    int n = MatchLength(data + cand, data + i, limit);
+                    if(n > best_len) {
+                        best_len = n;
+                        best_dist = (int) dist;
+                        if(n == limit) break;
+                    }
+                }
+                int32_t next = prev[cand & (DEFLATE_WINDOW - 1)];
+                if(next >= cand) break; // Slot reused by a newer position
+                cand = next;
+            }
+        }
+        if(best_len >= DEFLATE_MIN_MATCH) {
+            PutMatch(w, best_len, best_dist);
+            for(size_t end = i + best_len; i < end; i++) {
+                if(i + DEFLATE_MIN_MATCH <= len) insert(i);
+            }
+        } else {
+            PutSymbol(w, data[i]);
+            if(i + DEFLATE_MIN_MATCH <= len) insert(i);
+            i++;
+        }
+    }
+    PutSymbol(w, 256); // End of block
+    if(w.count > 0) out.push_back(w.bits & 0xFF);
+}
+
+static void PutBE(std::vector<uint8_t> &out, uint32_t v) {
+    for(int i = 3; i >= 0; i--) out.push_back((v >> (i * 8)) & 0xFF);
+}
+
+static void PutChunk(std::vector<uint8_t> &out, const char *type, const uint8_t *data, size_t len) {
+    PutBE(out, (uint32_t) len);
+    size_t start = out.size();
+    out.insert(out.end(), type, type + 4);
+    out.insert(out.end(), data, data + len);
+    PutBE(out, Crc32(&out[start], len + 4));
+}
+
+void EncodePng(const Image &img, std::vector<uint8_t> &out) {
+    static const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+    out.assign(signature, signature + 8);
+    std::vector<uint8_t> ihdr;
+    PutBE(ihdr, img.w);
+    PutBE(ihdr, img.h);
+    ihdr.push_back(8); // Bit depth
+    ihdr.push_back(6); // RGBA
+    ihdr.push_back(0);
+    ihdr.push_back(0);
+    ihdr.push_back(0);
+    PutChunk(out, "IHDR", ihdr.data(), ihdr.size());
+
+    // Scanlines are a filter byte (0, none) and the row
+    size_t row = (size_t) img.w * 4;
+    std::vector<uint8_t> raw((row + 1) * img.h);
+    for(size_t y = 0; y < (size_t) img.h; y++) {
+        raw[y * (row + 1)] = 0;
+        memcpy(&raw[y * (row + 1) + 1], img.rgba.data() + y * row, row);
+    }
+    // IDAT is written straight into out, its length is filled in after
+    size_t idat = out.size();
+    PutBE(out, 0);
+    out.insert(out.end(), { 'I', 'D', 'A', 'T', 0x78, 0x01 });
+    Deflate(raw.data(), raw.size(), out);
+    PutBE(out, Adler32(raw.data(), raw.size()));
+    uint32_t zlen = (uint32_t) (out.size() - idat - 8);
+    for(int i = 0; i < 4; i++) out[idat + i] = (zlen >> ((3 - i) * 8)) & 0xFF;
+    PutBE(out, Crc32(&out[idat + 4], zlen + 4));
+    PutChunk(out, "IEND", NULL, 0);
+}
+
+bool WritePng(const std::string &fname, const Image &img, std::string *error) {
+    std::vector<uint8_t> data;
+    EncodePng(img, data);
+    return WriteFileAtomic(fname, data.data(), data.size(), error);
+}
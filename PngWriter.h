@@ -0,0 +1,15 @@
+#ifndef STAGE9_PNGWRITER_H
+#define STAGE9_PNGWRITER_H
+
+#include "TextureLoader.h"
+
+// Minimal RGBA PNG encoder. The image data is one fixed Huffman deflate block with LZ77 matches,
+// which catches the repeated tiles of a map, and the same pixels always give the same bytes
+// (there's no timestamp or other metadata)
+void EncodePng(const Image &img, std::vector<uint8_t> &out);
+bool WritePng(const std::string &fname, const Image &img, std::string *error = NULL);
+
+uint32_t Crc32(const uint8_t *data, size_t len, uint32_t crc = 0);
+uint32_t Adler32(const uint8_t *data, size_t len, uint32_t adler = 1);
+
+#endif //STAGE9_PNGWRITER_H
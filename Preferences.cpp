@@ -19,6 +19,9 @@ static int PrefIniHandler(void* user, const char* section, const char* name, con
         //PREF("autoTSC", p->autoTSC = atoi(value));
         //PREF("autoPXA", p->autoPXA = atoi(value));
         PREF("npcListPath", p->npcListPath = value);
+        PREF("projectPath", p->projectPath = value);
+        PREF("autosaveInterval", p->autosaveInterval = atoi(value));
+        PREF("autosaveDirtyOnly", p->autosaveDirtyOnly = atoi(value));
     }
     SECTION("RecentPXM") {
         char str[8] = "FILE0";
@@ -39,7 +42,8 @@ static int PrefIniHandler(void* user, const char* section, const char* name, con
 
 Preferences::Preferences() {
     char *prefPath = SDL_GetPrefPath("Skychase", "DoukutsuEdit");
-    savePath = std::string(prefPath) + "preferences.ini";
+    dataPath = prefPath;
+    savePath = dataPath + "preferences.ini";
     SDL_free(prefPath);
     Load();
 }
@@ -51,6 +55,9 @@ void Preferences::ResetToDefault() {
     //autoTSC = true;
     //autoPXA = true;
     npcListPath = "";
+    projectPath = "";
+    autosaveInterval = 120;
+    autosaveDirtyOnly = true;
     for(int i = 0; i < 10; i++) {
         recentPXM[i] = "";
         recentTS[i] = "";
@@ -83,6 +90,9 @@ void Preferences::Save() {
         //fprintf(file, "autoTSC = %d\n", autoTSC);
         //fprintf(file, "autoPXA = %d\n", autoPXA);
         fprintf(file, "npcListPath = %s\n", npcListPath.c_str());
+        fprintf(file, "projectPath = %s\n", projectPath.c_str());
+        fprintf(file, "autosaveInterval = %d\n", autosaveInterval);
+        fprintf(file, "autosaveDirtyOnly = %d\n", autosaveDirtyOnly);
         fprintf(file, "\n");
         fprintf(file, "[RecentPXM]\n");
         for(int i = 0; i < 10; i++) {
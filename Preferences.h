@@ -21,11 +21,17 @@ public:
     void AddRecentPXM(std::string fn);
     void AddRecentTS(std::string fn);
 
+    // Per-user directory that preferences.ini lives in, ends with a separator
+    const std::string &DataPath() const { return dataPath; }
+
     int backGraphic;
     float backColor[4];
     //bool autoPXE, autoTSC, autoPXA;
     std::string recentPXM[10], recentTS[10];
     std::string npcListPath;
+    std::string projectPath; // Data directory of the open project, reopened on startup
+    int autosaveInterval; // Seconds, 0 disables autosave
+    bool autosaveDirtyOnly;
     // Editor State
     int editMode;
     int mapZoom;
@@ -34,6 +40,7 @@ public:
 private:
     Preferences();
 
+    std::string dataPath;
     std::string savePath;
 };
 
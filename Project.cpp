@@ -0,0 +1,305 @@
+#include "common.h"
+
+#include "FileIO.h"
+#include "Preferences.h"
+#include "ThreadPool.h"
+#include "TscCodec.h"
+#include "Project.h"
+
+namespace fs = std::filesystem;
+
+#define PROJECT_CACHE_MAGIC "DPC1"
+#define STAGE_TBL_ENTRY 0xE5
+#define MRMAP_ENTRY 0x74
+
+static const char *image_exts[] = { ".png", ".bmp", ".pbm" };
+
+static std::string FixedString(const uint8_t *data, size_t len) {
+    return std::string((const char*) data, strnlen((const char*) data, len));
+}
+
+bool ReadStageTable(const std::string &dir, std::vector<StageTableEntry> &table) {
+    table.clear();
+    std::vector<uint8_t> data;
+    bool mrmap = false;
+    for(const char *name : { "stage.tbl", "mrmap.bin" }) {
+        FILE *file = fopen((fs::path(dir) / name).string().c_str(), "rb");
+        if(!file) continue;
+        fseek(file, 0, SEEK_END);
+        data.resize(ftell(file));
+        fseek(file, 0, SEEK_SET);
+        data.resize(fread(data.data(), 1, data.size(), file));
+        fclose(file);
+        mrmap = name[0] == 'm';
+        break;
+    }
+    if(data.empty()) return false;
+    if(!mrmap) {
+        // 0x20 per name, the background type is an int, then the boss byte and the Japanese and English names
+        for(size_t at = 0; at + STAGE_TBL_ENTRY <= data.size(); at += STAGE_TBL_ENTRY) {
+            const uint8_t *e = &data[at];
+            std::string name = FixedString(e + 0xC5, 0x20);
+            if(name.empty()) name = FixedString(e + 0xA5, 0x20);
+            table.push_back({ FixedString(e, 0x20), FixedString(e + 0x20, 0x20), FixedString(e + 0x44, 0x20),
+                              FixedString(e + 0x64, 0x20), FixedString(e + 0x84, 0x20), name });
+        }
+        return true;
+    }
+    // Count first, then 0x10 per name and the background type is a byte
+    uint32_t count = data.size() >= 4 ? data[0] | (data[1] << 8) | (data[2] << 16) | ((uint32_t) data[3] << 24) : 0;
+    for(size_t i = 0; i < count && 4 + (i + 1) * MRMAP_ENTRY <= data.size(); i++) {
+        const uint8_t *e = &data[4 + i * MRMAP_ENTRY];
+        table.push_back({ FixedString(e, 0x10), FixedString(e + 0x10, 0x10), FixedString(e + 0x21, 0x10),
+                          FixedString(e + 0x31, 0x10), FixedString(e + 0x41, 0x10), FixedString(e + 0x52, 0x22) });
+    }
+    return true;
+}
+
+Project::Project() {
+    reused = 0;
+    seconds = 0;
+}
+
+// Size and modification time, the path is cleared if the file doesn't exist
+static bool Stamp(ProjectFile &f) {
+    std::error_code ec;
+    f.size = fs::file_size(f.path, ec);
+    if(!ec) f.mtime = fs::last_write_time(f.path, ec).time_since_epoch().count();
+    if(ec) f = { "", 0, 0, 0 };
+    return !ec;
+}
+
+static std::string FirstExisting(const std::vector<fs::path> &candidates) {
+    std::error_code ec;
+    for(auto &c : candidates) if(fs::is_regular_file(c, ec)) return c.generic_string();
+    return "";
+}
+
+static std::string FindImage(const fs::path &dir, const std::string &base) {
+    std::vector<fs::path> candidates;
+    for(auto ext : image_exts) candidates.push_back(dir / (base + ext));
+    return FirstExisting(candidates);
+}
+
+void Project::ScanStage(const std::string &root, const StageTableEntry *entry, int table_index, const std::string &name,
+                        const std::vector<ProjectStage> &cached, ProjectStage &stage, bool &from_cache) {
+    fs::path stage_dir = fs::path(root) / "Stage", tsc_dir = fs::path(root) / "tsc";
+    stage.name = name;
+    stage.title = entry ? entry->name : "";
+    stage.table_index = table_index;
+    stage.files[PROJECT_PXM].path = (stage_dir / (name + ".pxm")).generic_string();
+    stage.files[PROJECT_PXE].path = (stage_dir / (name + ".pxe")).generic_string();
+    // Same places LoadStage looks for the script
+    stage.files[PROJECT_TSC].path = FirstExisting({ stage_dir / (name + ".tsc"), stage_dir / (name + ".txt"),
+                                                    tsc_dir / (name + ".tsc"), tsc_dir / (name + ".txt") });
+    stage.files[PROJECT_TILESET].path = FindImage(stage_dir, "Prt" + (entry ? entry->tileset : name));
+    stage.npc_sheets[0] = entry && !entry->npc1.empty() ? FindImage(fs::path(root) / "Npc", "Npc" + entry->npc1) : "";
+    stage.npc_sheets[1] = entry && !entry->npc2.empty() ? FindImage(fs::path(root) / "Npc", "Npc" + entry->npc2) : "";
+    for(auto &f : stage.files) {
+        f.size = f.mtime = f.hash = 0;
+        if(!f.path.empty()) Stamp(f);
+    }
+    from_cache = false;
+    for(auto &c : cached) {
+        if(c.name != name) continue;
+        bool same = true;
+        for(int i = 0; i < PROJECT_FILE_COUNT; i++) {
+            same = same && c.files[i].path == stage.files[i].path && c.files[i].size == stage.files[i].size
+                    && c.files[i].mtime == stage.files[i].mtime;
+        }
+        if(same) {
+            // The stage table isn't stamped, it's cheap to take again
+            std::string title = stage.title, npc0 = stage.npc_sheets[0], npc1 = stage.npc_sheets[1];
+            stage = c;
+            stage.title = title;
+            stage.table_index = table_index;
+            stage.npc_sheets[0] = npc0;
+            stage.npc_sheets[1] = npc1;
+            from_cache = true;
+            return;
+        }
+        break;
+    }
+    stage.width = stage.height = stage.entities = 0;
+    stage.script_size = 0;
+    std::vector<uint8_t> data;
+    for(int i = 0; i < PROJECT_FILE_COUNT; i++) {
+        ProjectFile &f = stage.files[i];
+        if(f.path.empty()) continue;
+        if(i == PROJECT_TSC) {
+            std::string text;
+            bool obfuscated;
+            if(TscCodec::Read(f.path, text, obfuscated)) {
+                f.hash = HashBytes(text.data(), text.length());
+                stage.script_size = (uint32_t) text.length();
+            }
+            continue;
+        }
+        if(!ReadAll(f.path, data)) continue;
+        f.hash = HashBytes(data.data(), data.size());
+        if(i == PROJECT_PXM && data.size() >= 8) {
+            stage.width = data[4] | (data[5] << 8);
+            stage.height = data[6] | (data[7] << 8);
+        } else if(i == PROJECT_PXE && data.size() >= 6) {
+            stage.entities = data[4] | (data[5] << 8);
+        }
+    }
+}
+
+void Project::Open(const std::string &dir) {
+    auto scan = std::make_shared<Scan>();
+    scan->root = dir;
+    scan->remaining = 0;
+    scan->reused = 0;
+    scan->started = std::chrono::steady_clock::now();
+    scanning = scan;
+    ThreadPool::Instance().Submit([this, scan]() {
+        auto cached = std::make_shared<std::vector<ProjectStage>>();
+        std::string cache_path = CachePath(scan->root);
+        LoadCache(cache_path, scan->root, *cached);
+        auto table = std::make_shared<std::vector<StageTableEntry>>();
+        ReadStageTable(scan->root, *table);
+        // Every map in Stage/, in stage table order first
+        std::vector<std::string> names;
+        std::error_code ec;
+        for(auto &it : fs::directory_iterator(fs::path(scan->root) / "Stage", ec)) {
+            if(it.path().extension() == ".pxm") names.push_back(it.path().stem().string());
+        }
+        std::sort(names.begin(), names.end());
+        std::vector<std::pair<std::string, int>> order;
+        for(size_t i = 0; i < table->size(); i++) {
+            auto it = std::find(names.begin(), names.end(), (*table)[i].filename);
+            if(it == names.end()) continue;
+            order.push_back({ *it, (int) i });
+            names.erase(it);
+        }
+        for(auto &n : names) order.push_back({ n, -1 });
+        auto finish = [this, scan, cache_path]() {
+            SaveCache(cache_path, scan->root, scan->stages);
+            ThreadPool::Instance().RunOnMain([this, scan]() {
+                if(scan != scanning) return;
+                root = scan->root;
+                stages.swap(scan->stages);
+                reused = scan->reused;
+                seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - scan->started).count();
+                scanning.reset();
+            });
+        };
+        scan->stages.resize(order.size());
+        scan->remaining = (int) order.size();
+        if(order.empty()) {
+            finish();
+            return;
+        }
+        for(size_t i = 0; i < order.size(); i++) {
+            std::string name = order[i].first;
+            int index = order[i].second;
+            ThreadPool::Instance().Submit([scan, cached, table, name, index, i, finish]() {
+                bool from_cache;
+                ScanStage(scan->root, index >= 0 ? &(*table)[index] : NULL, index, name, *cached, scan->stages[i], from_cache);
+                if(from_cache) scan->reused++;
+                if(--scan->remaining == 0) finish();
+            });
+        }
+    });
+}
+
+void Project::Close() {
+    scanning.reset();
+    root.clear();
+    stages.clear();
+}
+
+const ProjectStage* Project::Find(const std::string &pxm_fname) const {
+    fs::path path = fs::path(pxm_fname).lexically_normal();
+    for(auto &s : stages) {
+        if(fs::path(s.files[PROJECT_PXM].path).lexically_normal() == path) return &s;
+    }
+    return NULL;
+}
+
+std::string Project::CachePath(const std::string &dir) {
+    char name[32];
+    snprintf(name, sizeof(name), "%08x.idx", HashBytes(dir.data(), dir.length()));
+    return Preferences::Instance().DataPath() + "projects/" + name;
+}
+
+// Cache file: magic, root path, stage count, then the stages. Integers are little endian,
+// strings are a 16 bit length and the bytes
+static void Put(std::vector<uint8_t> &buf, uint64_t v, int bytes) {
+    for(int i = 0; i < bytes; i++) buf.push_back((v >> (i * 8)) & 0xFF);
+}
+
+static void PutString(std::vector<uint8_t> &buf, const std::string &s) {
+    Put(buf, s.length(), 2);
+    buf.insert(buf.end(), s.begin(), s.end());
+}
+
+typedef struct {
+    const uint8_t *data;
+    size_t size, pos;
+    bool eof;
+} Reader;
+
+static uint64_t Get(Reader &r, int bytes) {
+    if(r.pos + bytes > r.size) { r.eof = true; return 0; }
+    uint64_t v = 0;
+    for(int i = 0; i < bytes; i++) v |= (uint64_t) r.data[r.pos++] << (i * 8);
+    return v;
+}
+
+static std::string GetString(Reader &r) {
+    size_t len = Get(r, 2);
+    if(r.pos + len > r.size) { r.eof = true; return ""; }
+    std::string s((const char*) r.data + r.pos, len);
+    r.pos += len;
+    return s;
+}
+
+void Project::SaveCache(const std::string &path, const std::string &dir, const std::vector<ProjectStage> &stages) {
+    std::vector<uint8_t> buf(PROJECT_CACHE_MAGIC, PROJECT_CACHE_MAGIC + 4);
+    PutString(buf, dir);
+    Put(buf, stages.size(), 4);
+    for(auto &s : stages) {
+        PutString(buf, s.name);
+        for(auto &f : s.files) {
+            PutString(buf, f.path);
+            Put(buf, f.size, 8);
+            Put(buf, f.mtime, 8);
+            Put(buf, f.hash, 4);
+        }
+        Put(buf, s.width, 2);
+        Put(buf, s.height, 2);
+        Put(buf, s.entities, 2);
+        Put(buf, s.script_size, 4);
+    }
+    std::error_code ec;
+    fs::create_directories(fs::path(path).parent_path(), ec);
+    WriteFileAtomic(path, buf.data(), buf.size());
+}
+
+bool Project::LoadCache(const std::string &path, const std::string &dir, std::vector<ProjectStage> &stages) {
+    std::vector<uint8_t> data;
+    if(!ReadAll(path, data) || data.size() < 4 || memcmp(data.data(), PROJECT_CACHE_MAGIC, 4) != 0) return false;
+    Reader r = { data.data(), data.size(), 4, false };
+    // Two roots can share a cache file name
+    if(GetString(r) != dir) return false;
+    uint32_t count = Get(r, 4);
+    for(uint32_t i = 0; i < count && !r.eof; i++) {
+        ProjectStage s;
+        s.name = GetString(r);
+        s.table_index = -1;
+        for(auto &f : s.files) {
+            f.path = GetString(r);
+            f.size = Get(r, 8);
+            f.mtime = Get(r, 8);
+            f.hash = Get(r, 4);
+        }
+        s.width = Get(r, 2);
+        s.height = Get(r, 2);
+        s.entities = Get(r, 2);
+        s.script_size = Get(r, 4);
+        if(!r.eof) stages.push_back(s);
+    }
+    return true;
+}
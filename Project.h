@@ -0,0 +1,70 @@
+#ifndef STAGE9_PROJECT_H
+#define STAGE9_PROJECT_H
+
+enum { PROJECT_PXM, PROJECT_PXE, PROJECT_TSC, PROJECT_TILESET, PROJECT_FILE_COUNT };
+
+typedef struct {
+    std::string path; // Empty when the stage doesn't have one
+    uint64_t size;
+    int64_t mtime;
+    uint32_t hash; // Of the contents, scripts are hashed decoded
+} ProjectFile;
+
+typedef struct {
+    std::string name;  // Base name of the map, like "Cave"
+    std::string title; // From the stage table
+    int table_index;   // -1 when the stage table doesn't list it (or there isn't one)
+    ProjectFile files[PROJECT_FILE_COUNT];
+    std::string npc_sheets[2];
+    uint16_t width, height;
+    uint16_t entities;
+    uint32_t script_size;
+} ProjectStage;
+
+typedef struct {
+    std::string tileset, filename, background, npc1, npc2, name;
+} StageTableEntry;
+
+// Reads stage.tbl (CS+) or mrmap.bin (freeware mods) from dir, false if neither is there
+bool ReadStageTable(const std::string &dir, std::vector<StageTableEntry> &table);
+
+// Catalogue of every stage in a game data directory (Stage/, tsc/ and Npc/ under it), so tools
+// don't have to open each map to know about it. Stages are scanned on the thread pool and
+// the result is cached under the preferences path; a stage whose files all have the same size
+// and modification time as last time comes from the cache without reading anything
+class Project {
+public:
+    Project();
+    void Open(const std::string &dir);
+    void Close();
+    bool Loading() const { return scanning != NULL; }
+    bool Empty() const { return root.empty(); }
+    const std::string &Root() const { return root; }
+    const std::vector<ProjectStage>& Stages() const { return stages; }
+    const ProjectStage* Find(const std::string &pxm_fname) const;
+    // Stages that came from the cache in the last scan, and how long it took
+    int Reused() const { return reused; }
+    double Seconds() const { return seconds; }
+
+private:
+    typedef struct {
+        std::string root;
+        std::vector<ProjectStage> stages;
+        std::atomic<int> remaining, reused;
+        std::chrono::steady_clock::time_point started;
+    } Scan;
+
+    std::string root;
+    std::vector<ProjectStage> stages;
+    std::shared_ptr<Scan> scanning; // Results of any other scan are dropped
+    int reused;
+    double seconds;
+
+    static std::string CachePath(const std::string &dir);
+    static void ScanStage(const std::string &root, const StageTableEntry *entry, int table_index,
+                          const std::string &name, const std::vector<ProjectStage> &cached, ProjectStage &stage, bool &reused);
+    static bool LoadCache(const std::string &path, const std::string &dir, std::vector<ProjectStage> &stages);
+    static void SaveCache(const std::string &path, const std::string &dir, const std::vector<ProjectStage> &stages);
+};
+
+#endif //STAGE9_PROJECT_H
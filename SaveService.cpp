@@ -0,0 +1,50 @@
+#include "common.h"
+#include "FileIO.h"
+#include "ThreadPool.h"
+#include "SaveService.h"
+
+void SaveService::Save(std::function<void(std::vector<SaveFile>&)> serialize,
+                       std::function<void(bool ok, const std::string &error)> done) {
+    std::lock_guard<std::mutex> lock(mutex);
+    queue.push_back({ std::move(serialize), std::move(done) });
+    if(!running) {
+        running = true;
+        ThreadPool::Instance().Submit([this] { Drain(); });
+    }
+}
+
+SaveService::~SaveService() {
+    std::unique_lock<std::mutex> lock(mutex);
+    idle.wait(lock, [this] { return !running; });
+}
+
+void SaveService::Drain() {
+    while(true) {
+        Job job;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if(queue.empty()) {
+                running = false;
+                idle.notify_all();
+                return;
+            }
+            job = std::move(queue.front());
+            queue.pop_front();
+        }
+        std::vector<SaveFile> files;
+        job.serialize(files);
+        bool ok = true;
+        std::string error;
+        for(auto &f : files) {
+            std::string e;
+            if(!WriteFileAtomic(f.path, f.data.data(), f.data.size(), &e) && ok) {
+                ok = false;
+                error = e;
+            }
+        }
+        if(job.done) {
+            auto done = std::move(job.done);
+            ThreadPool::Instance().RunOnMain([done, ok, error] { done(ok, error); });
+        }
+    }
+}
@@ -0,0 +1,43 @@
+#ifndef STAGE9_SAVESERVICE_H
+#define STAGE9_SAVESERVICE_H
+
+typedef struct {
+    std::string path;
+    std::vector<uint8_t> data;
+} SaveFile;
+
+// Saves run one at a time in the order they were queued, on a pool worker.
+// The serialize callback runs on the worker and fills in the files to write, so it should
+// only touch snapshots. Each file is written with WriteFileAtomic, and done is called on
+// the main thread with the first error, if any
+class SaveService {
+public:
+    static SaveService& Instance() {
+        static SaveService instance;
+        return instance;
+    }
+    SaveService(SaveService const&) = delete;
+    void operator=(SaveService const&)  = delete;
+
+    void Save(std::function<void(std::vector<SaveFile>&)> serialize,
+              std::function<void(bool ok, const std::string &error)> done);
+
+private:
+    SaveService() : running(false) {}
+    // Waits for queued saves, so quitting right after saving still writes the files
+    ~SaveService();
+
+    typedef struct {
+        std::function<void(std::vector<SaveFile>&)> serialize;
+        std::function<void(bool ok, const std::string &error)> done;
+    } Job;
+
+    std::mutex mutex;
+    std::condition_variable idle;
+    std::list<Job> queue;
+    bool running;
+
+    void Drain();
+};
+
+#endif //STAGE9_SAVESERVICE_H
@@ -0,0 +1,90 @@
+#include "common.h"
+
+#include "imgui/imgui.h"
+
+#include "ScriptBuffer.h"
+
+#define SCRIPT_MIN_CAPACITY 0x1000
+
+ScriptBuffer::ScriptBuffer() {
+    length = 0;
+    last_edit = { 0, 0, 0 };
+    edit_recorded = false;
+    jump_pending = false;
+    jump_pos = 0;
+    data = std::make_shared<std::vector<char>>(SCRIPT_MIN_CAPACITY, 0);
+}
+
+void ScriptBuffer::Reserve(size_t len) {
+    if(data.use_count() == 1 && len < data->size()) return;
+    size_t capacity = max(data->size(), (size_t) SCRIPT_MIN_CAPACITY);
+    while(capacity <= len) capacity *= 2;
+    auto grown = std::make_shared<std::vector<char>>(capacity, 0);
+    memcpy(grown->data(), data->data(), min(length, len) + 1);
+    data = grown;
+}
+
+void ScriptBuffer::Assign(const char *text, size_t len) {
+    // Whatever is shared with a snapshot stays as it is
+    if(data.use_count() > 1) data = std::make_shared<std::vector<char>>(SCRIPT_MIN_CAPACITY, 0);
+    length = 0;
+    Reserve(len);
+    memcpy(data->data(), text, len);
+    (*data)[len] = 0;
+    length = len;
+}
+
+int ScriptBuffer::EditCallback(ImGuiInputTextCallbackData *cb) {
+    auto *sb = (ScriptBuffer*) cb->UserData;
+    switch(cb->EventFlag) {
+        case ImGuiInputTextFlags_CallbackEdit: {
+            // cb->Buf is ImGui's copy with the edit, ours still has the text from before it.
+            // Whatever differs between the common prefix and suffix is the edit
+            const char *old_text = sb->data->data(), *new_text = cb->Buf;
+            size_t old_len = sb->length, new_len = cb->BufTextLen;
+            size_t prefix = 0, suffix = 0;
+            while(prefix < old_len && prefix < new_len && old_text[prefix] == new_text[prefix]) prefix++;
+            while(suffix < old_len - prefix && suffix < new_len - prefix
+                    && old_text[old_len - suffix - 1] == new_text[new_len - suffix - 1]) suffix++;
+            sb->last_edit = { prefix, old_len - prefix - suffix, new_len - prefix - suffix };
+            sb->edit_recorded = true;
+            break;
+        }
+        case ImGuiInputTextFlags_CallbackAlways:
+            if(sb->jump_pending) {
+                sb->jump_pending = false;
+                cb->CursorPos = cb->SelectionStart = cb->SelectionEnd = (int) min(sb->jump_pos, (size_t) cb->BufTextLen);
+            }
+            break;
+        case ImGuiInputTextFlags_CallbackResize:
+            // ImGui asks for this before every write into the buffer, not only when it needs to grow
+            sb->Reserve(cb->BufTextLen);
+            sb->length = cb->BufTextLen;
+            cb->Buf = sb->data->data();
+            cb->BufSize = (int) sb->data->size();
+            break;
+    }
+    return 0;
+}
+
+void ScriptBuffer::JumpTo(size_t pos) {
+    jump_pending = true;
+    jump_pos = pos;
+}
+
+bool ScriptBuffer::Edit(const char *label, const ImVec2 &size) {
+    ImGuiInputTextFlags flags = ImGuiInputTextFlags_CallbackResize | ImGuiInputTextFlags_CallbackEdit;
+    if(jump_pending) {
+        // Callbacks only run while the editor is active
+        flags |= ImGuiInputTextFlags_CallbackAlways;
+        ImGui::SetKeyboardFocusHere();
+    }
+    size_t before = length;
+    edit_recorded = false;
+    bool changed = ImGui::InputTextMultiline(label, data->data(), data->size(), size, flags, EditCallback, this);
+    if(changed && (!edit_recorded || before - last_edit.removed + last_edit.inserted != length)) {
+        // Changed without an edit callback, like reverting with Escape
+        last_edit = { 0, before, length };
+    }
+    return changed;
+}
@@ -0,0 +1,53 @@
+#ifndef STAGE9_SCRIPTBUFFER_H
+#define STAGE9_SCRIPTBUFFER_H
+
+struct ImVec2;
+struct ImGuiInputTextCallbackData;
+
+// One change to the text, removed bytes at pos were replaced by inserted new ones
+typedef struct {
+    size_t pos, removed, inserted;
+} ScriptEdit;
+
+// Read-only view of the script at some point, for serializing on a worker
+typedef struct {
+    std::shared_ptr<const std::vector<char>> data;
+    size_t length;
+    const char *Text() const { return data ? data->data() : ""; }
+} ScriptSnapshot;
+
+// Text of the open script, with no size limit. ImGui edits it in place, so the gap is kept
+// at the end as spare capacity and grows by doubling. Snapshots share the storage rather than
+// copying it, the editor only makes its own copy if it is edited while a snapshot is still held
+class ScriptBuffer {
+public:
+    ScriptBuffer();
+
+    const char *Text() const { return data->data(); }
+    size_t Length() const { return length; }
+    bool Empty() const { return length == 0; }
+
+    void Assign(const char *text, size_t len);
+    void Clear() { Assign("", 0); }
+    ScriptSnapshot Snapshot() const { return { data, length }; }
+    // Multiline ImGui editor bound to the buffer, returns true when the text was changed
+    // and LastEdit() says where
+    bool Edit(const char *label, const ImVec2 &size);
+    const ScriptEdit &LastEdit() const { return last_edit; }
+    // Puts the editor's cursor at pos (and scrolls there) the next time it is drawn
+    void JumpTo(size_t pos);
+
+private:
+    std::shared_ptr<std::vector<char>> data; // Text, terminator, then the gap
+    size_t length;
+    ScriptEdit last_edit;
+    bool edit_recorded;
+    bool jump_pending;
+    size_t jump_pos;
+
+    // Makes room for len bytes of text plus the terminator, in storage nothing else shares
+    void Reserve(size_t len);
+    static int EditCallback(ImGuiInputTextCallbackData *cb);
+};
+
+#endif //STAGE9_SCRIPTBUFFER_H
@@ -3,11 +3,13 @@
 
 #include "imgui/imgui.h"
 #include "imgui/ImGuiFileDialog.h"
-#define STB_IMAGE_IMPLEMENTATION
-#include "imgui/stb_image.h"
 #include "glad.h"
 
 #include "Preferences.h"
+#include "SaveService.h"
+#include "TextureLoader.h"
+#include "ThreadPool.h"
+#include "TscCodec.h"
 #include "StageWindow.h"
 
 static void chkerr(int line) {
@@ -62,6 +64,8 @@ const char *fragment_src =
         "    fragColor = texcolor;\n"
         "}\n";
 
+#define AUTOSAVE_EXT ".autosave"
+
 uint32_t StageWindow::CompileShader(int type, const char *source) {
     if(glCreateShader == NULL || glGenFramebuffers == NULL) {
         printf("Your graphics driver does not support OpenGL 3.2.\n");
@@ -156,8 +160,20 @@ StageWindow::StageWindow() {
     selectedTile = 0;
     tileRange[0] = tileRange[1] = 0;
     tileRange[2] = tileRange[3] = 1;
-    tsc_text[0] = 0;
+    tsc_saved = HashBytes("", 0);
     tsc_obfuscated = false;
+    map_rev = tsc_rev = pxa_rev = 0;
+    autosave_rev[0] = autosave_rev[1] = autosave_rev[2] = 0;
+    lastAutosave = 0;
+    autosaveBusy = false;
+    tileset_request = npc_request = 0;
+    status_error = false;
+    restore_pending = false;
+    saved_rev[0] = saved_rev[1] = saved_rev[2] = 0;
+    lint_jump_pos = 0;
+    stage_thumbnails = true;
+    memset(pxa, 0, PXA_MAX);
+    memset(pxa_saved, 0, PXA_MAX);
     CreateTilesetFB();
     // Blank white texture
     glGenTextures(1, &white_tex);
@@ -180,10 +196,7 @@ StageWindow::StageWindow() {
     chkerr(__LINE__);
     InitShaders();
 
-    Preferences &pref = Preferences::Instance();
-    if(pref.recentPXM[0].length() > 0) OpenMap(pref.recentPXM[0]);
-    if(pref.recentTS[0].length() > 0) OpenTileset(pref.recentTS[0]);
-    if(pref.npcListPath.length() > 0) LoadNpcList(pref.npcListPath);
+    restore_pending = true;
 }
 
 StageWindow::~StageWindow() {
@@ -326,273 +339,1055 @@ void StageWindow::DrawGrid(int xx, int yy) {
     }
 }
 
-uint32_t StageWindow::LoadTexture(const char *fname, int *w, int *h, bool transparent) {
-    uint32_t texid = 0;
-    FILE *file = fopen(fname, "rb");
-    if(file) {
-        stbi_uc *rgba_data = stbi_load_from_file(file, w, h, NULL, STBI_rgb_alpha);
-        if(rgba_data) {
-            if(transparent) {
-                auto pixels = (uint32_t*) rgba_data;
-                uint32_t tcolor = pixels[0];
-                for(int i = 0; i < *w * *h; i++) if(pixels[i] == tcolor) pixels[i] = 0;
-            }
-            glGenTextures(1, &texid);
-            glBindTexture(GL_TEXTURE_2D, texid);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, *w, *h, 0, GL_RGBA, GL_UNSIGNED_BYTE, rgba_data);
-            chkerr(__LINE__);
-            stbi_image_free(rgba_data);
-        }
-        fclose(file);
-    }
-    return texid;
-}
-
 void StageWindow::FreeTexture(uint32_t tex) {
-    glDeleteTextures(1, &tex);
+    TextureLoader::Instance().Release(tex);
 }
 
-void StageWindow::OpenMap(std::string fname) {
-    history.Clear();
+// Runs on a worker, must not touch the StageWindow
+static void LoadStage(StageLoad &load, const std::string &fname) {
+    load.has_pxm = load.has_pxe = load.has_tsc = false;
+    load.tsc_obfuscated = false;
+    load.journal_hash = 0;
     FILE *file = fopen(fname.c_str(), "rb");
     if(file) {
-        pxm_fname = fname;
-        pxm.Load(file);
+        load.pxm_fname = fname;
+        load.pxm.Load(file);
+        load.has_pxm = true;
         fclose(file);
     }
+    load.progress++;
     // Try to open PXE with the same base name
-    selectedEntity = -1;
     std::string newfn = fname.substr(0, fname.find_last_of('.')) + ".pxe";
     file = fopen(newfn.c_str(), "rb");
     if(file) {
-        pxe_fname = newfn;
-        pxe.Load(file);
+        load.pxe_fname = newfn;
+        load.pxe.Load(file);
+        load.has_pxe = true;
         fclose(file);
-        Preferences::Instance().AddRecentPXM(pxm_fname);
     }
+    load.progress++;
+    // Edits that never got saved are still in the journal
+    if(load.has_pxm) Journal::Load(fname, &load.journal_hash, load.journal_records);
+    load.progress++;
     // Try to open TSC/TXT with the same base name in ./ or ../tsc
-    tsc_text[0] = 0;
-    tsc_obfuscated = false;
     std::string tscfn = fname.substr(0, fname.find_last_of('.')) + ".tsc";
     std::string txtfn = fname.substr(0, fname.find_last_of('.')) + ".txt";
-    file = fopen(tscfn.c_str(), "rb");
-    if(file) {
-        tsc_fname = tscfn;
-    } else {
-        file = fopen(txtfn.c_str(), "rb");
-        if(file) {
-            tsc_fname = txtfn;
-        } else {
-            size_t dirpos = tscfn.find("/Stage/");
-            if(dirpos != std::string::npos) {
-                std::string tscfn2 = tscfn.replace(dirpos, 7, "/tsc/");
-                std::string txtfn2 = txtfn.replace(dirpos, 7, "/tsc/");
-                file = fopen(tscfn2.c_str(), "rb");
-                if(file) {
-                    tsc_fname = tscfn2;
+    std::vector<std::string> candidates = { tscfn, txtfn };
+    size_t dirpos = tscfn.find("/Stage/");
+    if(dirpos != std::string::npos) {
+        candidates.push_back(tscfn.replace(dirpos, 7, "/tsc/"));
+        candidates.push_back(txtfn.replace(dirpos, 7, "/tsc/"));
+    }
+    for(auto &fn : candidates) {
+        if(TscCodec::Read(fn, load.tsc, load.tsc_obfuscated)) {
+            load.tsc_fname = fn;
+            load.has_tsc = true;
+            break;
+        }
+    }
+    // Only its labels are needed, to tell which events exist outside the stage
+    std::string head;
+    load.head_fname.clear();
+    if(load.has_tsc && TscCodec::ReadHead(load.tsc_fname, head, load.head_fname)) {
+        load.head_index.Build(head.data(), head.length());
+    }
+    load.progress++;
+}
+
+static bool SamePath(const std::string &a, const std::string &b) {
+    return std::filesystem::path(a).lexically_normal() == std::filesystem::path(b).lexically_normal();
+}
+
+void StageWindow::RestoreSession() {
+    Preferences &pref = Preferences::Instance();
+    if(pref.recentPXM[0].length() > 0) OpenMap(pref.recentPXM[0]);
+    if(pref.recentTS[0].length() > 0) OpenTileset(pref.recentTS[0]);
+    npc_list_deferred = pref.npcListPath;
+    if(!pref.projectPath.empty()) project.Open(pref.projectPath);
+}
+
+void StageWindow::OpenProject(const std::string &dir) {
+    if(!SamePath(dir, project.Root())) thumbnails.Clear();
+    project.Open(dir);
+    Preferences::Instance().projectPath = dir;
+    Preferences::Instance().Save();
+}
+
+void StageWindow::OpenStage(const ProjectStage &stage) {
+    std::string pxm = stage.files[PROJECT_PXM].path, tileset = stage.files[PROJECT_TILESET].path;
+    bool new_tileset = !tileset.empty() && !SamePath(tileset, tileset_fname);
+    ConfirmDiscard(new_tileset, [this, pxm, tileset, new_tileset]() {
+        OpenMap(pxm);
+        if(new_tileset) OpenTileset(tileset);
+    });
+}
+
+void StageWindow::DrawStageBrowser() {
+    if(project.Empty()) {
+        ImGui::TextDisabled("%s", project.Loading() ? "Scanning..." : "No project open");
+        if(!project.Loading() && ImGui::Button("Open Project...")) {
+            ImGuiFileDialog::Instance()->OpenDialog("OpenProjectDir", "Open Project", NULL, ".");
+        }
+        return;
+    }
+    const std::vector<ProjectStage> &stages = project.Stages();
+    ImGui::Text("%d stages in %s", (int) stages.size(), project.Root().c_str());
+    ImGui::SameLine();
+    ImGui::BeginDisabled(project.Loading());
+    if(ImGui::SmallButton("Rescan")) project.Open(project.Root());
+    ImGui::EndDisabled();
+    if(ImGui::IsItemHovered()) {
+        ImGui::SetTooltip("Last scan: %.0f ms, %d of %d stages unchanged", project.Seconds() * 1000, project.Reused(),
+                          (int) stages.size());
+    }
+    ImGui::SameLine();
+    ImGui::Checkbox("Thumbnails", &stage_thumbnails);
+    static char filter[64];
+    ImGui::SetNextItemWidth(-1);
+    ImGui::InputTextWithHint("##StageFilter", "Filter", filter, sizeof(filter));
+    std::vector<const ProjectStage*> shown;
+    for(auto &s : stages) {
+        if(filter[0] && s.name.find(filter) == std::string::npos && s.title.find(filter) == std::string::npos) continue;
+        shown.push_back(&s);
+    }
+    if(stage_thumbnails) {
+        DrawStageGrid(shown);
+        return;
+    }
+    if(ImGui::BeginTable("##Stages", 5, ImGuiTableFlags_RowBg | ImGuiTableFlags_Resizable | ImGuiTableFlags_ScrollY)) {
+        ImGui::TableSetupScrollFreeze(0, 1);
+        ImGui::TableSetupColumn("Map", ImGuiTableColumnFlags_WidthFixed, 80);
+        ImGui::TableSetupColumn("Name", ImGuiTableColumnFlags_WidthStretch);
+        ImGui::TableSetupColumn("Size", ImGuiTableColumnFlags_WidthFixed, 60);
+        ImGui::TableSetupColumn("Entities", ImGuiTableColumnFlags_WidthFixed, 50);
+        ImGui::TableSetupColumn("Script", ImGuiTableColumnFlags_WidthFixed, 50);
+        ImGui::TableHeadersRow();
+        const ProjectStage *clicked = NULL;
+        for(auto sp : shown) {
+            const ProjectStage &s = *sp;
+            ImGui::TableNextRow();
+            ImGui::TableNextColumn();
+            bool open = SamePath(s.files[PROJECT_PXM].path, pxm_fname);
+            if(ImGui::Selectable(s.name.c_str(), open, ImGuiSelectableFlags_SpanAllColumns)) clicked = &s;
+            ImGui::TableNextColumn();
+            ImGui::TextUnformatted(s.title.c_str());
+            ImGui::TableNextColumn();
+            ImGui::Text("%hux%hu", s.width, s.height);
+            ImGui::TableNextColumn();
+            ImGui::Text("%hu", s.entities);
+            ImGui::TableNextColumn();
+            if(s.files[PROJECT_TSC].path.empty()) ImGui::TextDisabled("none");
+            else ImGui::Text("%.1fK", s.script_size / 1024.0f);
+        }
+        ImGui::EndTable();
+        if(clicked) OpenStage(*clicked);
+    }
+}
+
+void StageWindow::DrawStageGrid(const std::vector<const ProjectStage*> &shown) {
+    ImGui::BeginChild("##StageGrid");
+    ImGuiStyle &style = ImGui::GetStyle();
+    float cell = THUMBNAIL_SIZE + style.FramePadding.x * 2;
+    float row_height = cell + ImGui::GetTextLineHeightWithSpacing() + style.ItemSpacing.y;
+    int columns = max(1, (int) ((ImGui::GetContentRegionAvail().x + style.ItemSpacing.x) / (cell + style.ItemSpacing.x)));
+    int rows = ((int) shown.size() + columns - 1) / columns;
+    const ProjectStage *clicked = NULL;
+    // Only thumbnails scrolled into view are asked for, the rest are made when they show up
+    ImGuiListClipper clipper;
+    clipper.Begin(rows, row_height);
+    while(clipper.Step()) {
+        for(int row = clipper.DisplayStart; row < clipper.DisplayEnd; row++) {
+            for(int col = 0; col < columns; col++) {
+                size_t i = (size_t) row * columns + col;
+                if(i >= shown.size()) break;
+                const ProjectStage &s = *shown[i];
+                if(col > 0) ImGui::SameLine();
+                ImGui::BeginGroup();
+                ImGui::PushID((int) i);
+                bool open = SamePath(s.files[PROJECT_PXM].path, pxm_fname);
+                if(open) ImGui::PushStyleColor(ImGuiCol_Button, ImGui::GetStyleColorVec4(ImGuiCol_ButtonActive));
+                TextureInfo t = thumbnails.Get(s);
+                bool pressed;
+                if(t.tex) {
+                    // Fit the longer side, keeping the map's shape
+                    float scale = (float) THUMBNAIL_SIZE / max(t.w, t.h);
+                    ImVec2 size(t.w * scale, t.h * scale);
+                    ImVec2 pad((cell - size.x) / 2, (cell - size.y) / 2);
+                    ImGui::PushStyleVar(ImGuiStyleVar_FramePadding, pad);
+                    pressed = ImGui::ImageButton((ImTextureID) t.tex, size);
+                    ImGui::PopStyleVar();
                 } else {
-                    file = fopen(txtfn2.c_str(), "rb");
-                    if(file) tsc_fname = txtfn2;
+                    pressed = ImGui::Button(s.files[PROJECT_TILESET].path.empty() ? "No tileset" : "...", ImVec2(cell, cell));
                 }
+                if(open) ImGui::PopStyleColor();
+                if(pressed) clicked = &s;
+                if(ImGui::IsItemHovered()) {
+                    ImGui::SetTooltip("%s\n%s\n%hux%hu, %hu entities", s.name.c_str(), s.title.c_str(), s.width, s.height,
+                                      s.entities);
+                }
+                ImGui::PushTextWrapPos(ImGui::GetCursorPosX() + cell);
+                ImGui::TextUnformatted(s.name.c_str());
+                ImGui::PopTextWrapPos();
+                ImGui::PopID();
+                ImGui::EndGroup();
             }
         }
     }
-    if(file) {
-        fseek(file, 0, SEEK_END);
-        size_t size = ftell(file);
-        if(size > TSC_MAX-1) size = TSC_MAX-1;
-        fseek(file, 0, SEEK_SET);
-        fread(tsc_text, 1, size, file);
-        tsc_text[size] = 0;
-        // The <END command should be in every script, so if it's not found
-        // assume the TSC is obfuscated
-        if(std::string(tsc_text).find("<END") == std::string::npos) {
-            tsc_obfuscated = true;
-            char key = tsc_text[size / 2];
-            for(size_t i = 0; i < size; i++) {
-                if(tsc_text[i] != key) tsc_text[i] -= key;
+    clipper.End();
+    ImGui::EndChild();
+    if(clicked) OpenStage(*clicked);
+}
+
+void StageWindow::OpenMap(std::string fname) {
+    auto load = std::make_shared<StageLoad>();
+    load->progress = 0;
+    load->started = std::chrono::steady_clock::now();
+    loading = load;
+    ThreadPool::Instance().Submit([this, load, fname]() {
+        LoadStage(*load, fname);
+        ThreadPool::Instance().RunOnMain([this, load]() { FinishOpenMap(load); });
+    });
+}
+
+void StageWindow::FinishOpenMap(std::shared_ptr<StageLoad> load) {
+    if(load != loading) {
+        // Another stage was opened before this one finished loading
+        for(auto &r : load->journal_records) FreeHistEntry(r.entry);
+        return;
+    }
+    loading.reset();
+#ifdef DEBUG
+    printf("Opened %s in %.1f ms\n", load->pxm_fname.c_str(), std::chrono::duration<double, std::milli>(
+            std::chrono::steady_clock::now() - load->started).count());
+#endif
+    history.Clear();
+    if(load->has_pxm) {
+        pxm_fname = load->pxm_fname;
+        pxm = load->pxm;
+        pxm_saved = pxm.Snapshot();
+    }
+    selectedEntity = -1;
+    if(load->has_pxe) {
+        pxe_fname = load->pxe_fname;
+        pxe = load->pxe;
+        Preferences::Instance().AddRecentPXM(pxm_fname);
+    }
+    for(auto &r : journal_records) FreeHistEntry(r.entry);
+    journal_records.clear();
+    if(load->has_pxm) {
+        journal_hash = load->journal_hash;
+        journal_records.swap(load->journal_records);
+        if(journal_records.empty()) journal.Open(pxm_fname, MapHash());
+    }
+    // Nothing new to autosave until the next edit
+    autosave_rev[0] = saved_rev[0] = map_rev;
+    autosave_rev[1] = saved_rev[1] = tsc_rev;
+    pxe_saved = pxe;
+    tsc_text.Clear();
+    tsc_obfuscated = false;
+    if(load->has_tsc) {
+        tsc_fname = load->tsc_fname;
+        tsc_text.Assign(load->tsc.c_str(), load->tsc.length());
+        tsc_obfuscated = load->tsc_obfuscated;
+    }
+    head_index = load->head_index;
+    RebuildScriptIndex();
+    tsc_saved = HashBytes(tsc_text.Text(), tsc_text.Length());
+    WatchFiles();
+    if(!lint_jump_fname.empty() && load->has_tsc && SamePath(lint_jump_fname, tsc_fname)) {
+        tsc_text.JumpTo(lint_jump_pos);
+        ImGui::SetWindowFocus("Script");
+    }
+    lint_jump_fname.clear();
+}
+
+static uint32_t StageHash(const PXM &map, const PXE &entities) {
+    return map.Hash() ^ (entities.Hash() * 16777619u);
+}
+
+// History entries that take one version of the stage to another: a resize, one tile change
+// covering every changed tile, then the entities in order
+static void DiffStage(const PXM &from_pxm, const PXE &from_pxe, const PXM &to_pxm, const PXE &to_pxe,
+                      std::vector<HistEntry*> &entries) {
+    PXM map = from_pxm.Snapshot();
+    if(map.Width() != to_pxm.Width() || map.Height() != to_pxm.Height()) {
+        uint16_t old_w = map.Width(), old_h = map.Height();
+        std::vector<uint8_t> old_tiles(old_w * old_h), new_tiles(old_w * old_h);
+        for(uint16_t y = 0; y < old_h; y++) {
+            for(uint16_t x = 0; x < old_w; x++) old_tiles[y * old_w + x] = map.Tile(x, y);
+        }
+        map.Resize(to_pxm.Width(), to_pxm.Height());
+        for(uint16_t y = 0; y < old_h; y++) {
+            for(uint16_t x = 0; x < old_w; x++) new_tiles[y * old_w + x] = map.Tile(x, y);
+        }
+        HistEntry *e = (HistEntry*) malloc(sizeof(HistEntry));
+        e->action = MAP_SIZE;
+        e->map_size.old_w = old_w;
+        e->map_size.old_h = old_h;
+        e->map_size.new_w = map.Width();
+        e->map_size.new_h = map.Height();
+        e->map_size.delta = PackTileDelta(old_tiles.data(), new_tiles.data(), old_tiles.size(), &e->map_size.delta_len);
+        entries.push_back(e);
+    }
+    uint16_t w = map.Width(), h = map.Height();
+    uint16_t x0 = w, y0 = h, x1 = 0, y1 = 0;
+    for(uint16_t y = 0; y < h; y++) {
+        for(uint16_t x = 0; x < w; x++) {
+            if(map.Tile(x, y) == to_pxm.Tile(x, y)) continue;
+            x0 = min(x0, x); y0 = min(y0, y);
+            x1 = max(x1, x); y1 = max(y1, y);
+        }
+    }
+    if(x0 <= x1 && y0 <= y1) {
+        HistEntry *e = (HistEntry*) malloc(sizeof(HistEntry));
+        e->action = MAP_MOD;
+        e->map_mod.x = x0;
+        e->map_mod.y = y0;
+        e->map_mod.w = x1 - x0 + 1;
+        e->map_mod.h = y1 - y0 + 1;
+        e->map_mod.tx = e->map_mod.ty = 0;
+        std::vector<uint8_t> old_tiles(e->map_mod.w * e->map_mod.h), new_tiles(old_tiles.size());
+        for(uint16_t y = 0; y < e->map_mod.h; y++) {
+            for(uint16_t x = 0; x < e->map_mod.w; x++) {
+                old_tiles[y * e->map_mod.w + x] = map.Tile(x0 + x, y0 + y);
+                new_tiles[y * e->map_mod.w + x] = to_pxm.Tile(x0 + x, y0 + y);
             }
         }
-        fclose(file);
+        e->map_mod.delta = PackTileDelta(old_tiles.data(), new_tiles.data(), old_tiles.size(), &e->map_mod.delta_len);
+        entries.push_back(e);
+    }
+    uint16_t count = from_pxe.Size();
+    for(uint16_t i = 0; i < min(count, to_pxe.Size()); i++) {
+        Entity old_entity = from_pxe.GetEntity(i), new_entity = to_pxe.GetEntity(i);
+        if(memcmp(&old_entity, &new_entity, sizeof(Entity)) == 0) continue;
+        HistEntry *e = (HistEntry*) malloc(sizeof(HistEntry));
+        e->action = ENTITY_MOD;
+        e->entity_mod.old_entity = old_entity;
+        e->entity_mod.new_entity = new_entity;
+        e->entity_mod.index = i;
+        entries.push_back(e);
+    }
+    for(; count > to_pxe.Size(); count--) {
+        HistEntry *e = (HistEntry*) malloc(sizeof(HistEntry));
+        e->action = ENTITY_DEL;
+        e->entity_del.index = count - 1;
+        e->entity_del.old_entity = from_pxe.GetEntity(count - 1);
+        entries.push_back(e);
+    }
+    for(; count < to_pxe.Size(); count++) {
+        HistEntry *e = (HistEntry*) malloc(sizeof(HistEntry));
+        e->action = ENTITY_ADD;
+        e->entity_add.new_entity = to_pxe.GetEntity(count);
+        entries.push_back(e);
     }
 }
 
 void StageWindow::SaveMap() {
-    FILE *file = fopen(pxm_fname.c_str(), "wb");
-    if(file) {
-        pxm.Save(file);
-        fclose(file);
+    // Serialize and write on a worker from a snapshot, the map can keep being edited meanwhile
+    PXM map = pxm.Snapshot();
+    std::vector<uint8_t> entities;
+    pxe.Save(entities);
+    PXE ents = pxe;
+    std::string pxmfn = pxm_fname, pxefn = pxe_fname;
+    uint32_t rev = map_rev;
+    SaveService::Instance().Save([map, entities, pxmfn, pxefn](std::vector<SaveFile> &files) {
+        files.push_back({ pxmfn, {} });
+        map.Save(files.back().data);
+        files.push_back({ pxefn, entities });
+    }, [this, map, ents, pxmfn, rev](bool ok, const std::string &error) {
+        if(!ok) {
+            SetStatus("Failed to save map: " + error, true);
+            return;
+        }
+        SetStatus("Saved " + pxmfn);
+        if(pxmfn != pxm_fname) return; // Another map was opened while saving
+        pxm_saved = map;
+        pxe_saved = ents;
+        autosave_rev[0] = saved_rev[0] = rev;
+        WatchFiles();
+        // The journal only needs edits made after this point, plus any made while saving
+        RebaseJournal(map, ents);
+    });
+}
+
+void StageWindow::SaveScript() {
+    ScriptSnapshot script = tsc_text.Snapshot();
+    bool obfuscated = tsc_obfuscated;
+    std::string tscfn = tsc_fname;
+    uint32_t rev = tsc_rev;
+    SaveService::Instance().Save([script, obfuscated, tscfn](std::vector<SaveFile> &files) {
+        files.push_back({ tscfn, std::vector<uint8_t>(script.Text(), script.Text() + script.length) });
+        if(obfuscated) TscCodec::EncodeScript(files.back().data.data(), script.length);
+    }, [this, script, tscfn, rev](bool ok, const std::string &error) {
+        if(!ok) {
+            SetStatus("Failed to save script: " + error, true);
+            return;
+        }
+        SetStatus("Saved " + tscfn);
+        if(tscfn != tsc_fname) return;
+        autosave_rev[1] = saved_rev[1] = rev;
+        tsc_saved = HashBytes(script.Text(), script.length);
+        WatchFiles();
+    });
+}
+
+void StageWindow::RebaseJournal(const PXM &base_pxm, const PXE &base_pxe) {
+    journal.Open(pxm_fname, StageHash(base_pxm, base_pxe));
+    std::vector<HistEntry*> entries;
+    DiffStage(base_pxm, base_pxe, pxm, pxe, entries);
+    // Only the last record's hash is checked on replay
+    for(auto e : entries) {
+        journal.Record(JOURNAL_APPLY, e, MapHash());
+        FreeHistEntry(e);
     }
-    file = fopen(pxe_fname.c_str(), "wb");
-    if(file) {
-        pxe.Save(file);
-        fclose(file);
+}
+
+void StageWindow::SetStatus(const std::string &text, bool error) {
+    status_text = text;
+    status_error = error;
+}
+
+void StageWindow::AddHistory(HistEntry *e) {
+    map_rev++;
+    history.AddEntry(e);
+    journal.Record(JOURNAL_ADD, e, MapHash());
+}
+
+void StageWindow::Undo() {
+    HistEntry *e = history.Undo();
+    if(e) {
+        ApplyHistory(e, false);
+        journal.Record(JOURNAL_UNDO, e, MapHash());
     }
 }
 
-void StageWindow::SaveScript() {
-    FILE *file = fopen(tsc_fname.c_str(), "wb");
-    if(file) {
-        char data[TSC_MAX];
-        size_t len = strnlen(tsc_text, TSC_MAX);
-        if(tsc_obfuscated) {
-            char key = tsc_text[len / 2];
-            int i = 0;
-            while(tsc_text[i] != 0) {
-                data[i] = tsc_text[i] == key ? tsc_text[i] : tsc_text[i] + key;
-                i++;
+void StageWindow::Redo() {
+    HistEntry *e = history.Redo();
+    if(e) {
+        ApplyHistory(e, true);
+        journal.Record(JOURNAL_REDO, e, MapHash());
+    }
+}
+
+void StageWindow::ClearHistory() {
+    history.Clear();
+    journal.Record(JOURNAL_CLEAR, NULL, MapHash());
+}
+
+uint32_t StageWindow::MapHash() {
+    return StageHash(pxm, pxe);
+}
+
+void StageWindow::ReplayJournal() {
+    uint32_t expected = journal_records.back().hash;
+    for(auto &r : journal_records) {
+        switch(r.op) {
+            case JOURNAL_ADD:
+                ApplyHistory(r.entry, true);
+                history.AddEntry(r.entry);
+                break;
+            case JOURNAL_UNDO:
+                // Entries older than the journal aren't in the history, the record has a copy
+                if(HistEntry *e = history.Undo()) {
+                    ApplyHistory(e, false);
+                    FreeHistEntry(r.entry);
+                } else {
+                    ApplyHistory(r.entry, false);
+                    history.AddUndone(r.entry);
+                }
+                break;
+            case JOURNAL_REDO:
+                if(HistEntry *e = history.Redo()) {
+                    ApplyHistory(e, true);
+                    FreeHistEntry(r.entry);
+                } else {
+                    ApplyHistory(r.entry, true);
+                    history.AddEntry(r.entry);
+                }
+                break;
+            case JOURNAL_CLEAR:
+                history.Clear();
+                break;
+            case JOURNAL_APPLY:
+                ApplyHistory(r.entry, true);
+                FreeHistEntry(r.entry);
+                break;
+        }
+    }
+    journal_records.clear();
+    selectedEntity = -1;
+    journal.Resume(pxm_fname);
+    if(MapHash() != expected) SetStatus("The recovered map doesn't match the edits, check it before saving", true);
+}
+
+void StageWindow::DiscardJournal() {
+    for(auto &r : journal_records) FreeHistEntry(r.entry);
+    journal_records.clear();
+    journal.Open(pxm_fname, MapHash());
+}
+
+void StageWindow::ResizeMap(uint16_t w, uint16_t h) {
+    uint16_t old_w = pxm.Width(), old_h = pxm.Height();
+    std::vector<uint8_t> old_tiles(old_w * old_h), new_tiles(old_w * old_h);
+    for(uint16_t y = 0; y < old_h; y++) {
+        for(uint16_t x = 0; x < old_w; x++) old_tiles[y * old_w + x] = pxm.Tile(x, y);
+    }
+    pxm.Resize(w, h);
+    // Compare against what is left at the same coordinates, so only the cropped tiles are kept
+    for(uint16_t y = 0; y < old_h; y++) {
+        for(uint16_t x = 0; x < old_w; x++) new_tiles[y * old_w + x] = pxm.Tile(x, y);
+    }
+    HistEntry *e = (HistEntry*) malloc(sizeof(HistEntry));
+    e->action = MAP_SIZE;
+    e->map_size.old_w = old_w;
+    e->map_size.old_h = old_h;
+    e->map_size.new_w = w;
+    e->map_size.new_h = h;
+    e->map_size.delta = PackTileDelta(old_tiles.data(), new_tiles.data(), old_tiles.size(), &e->map_size.delta_len);
+    AddHistory(e);
+}
+
+void StageWindow::ApplyHistory(HistEntry *e, bool redo) {
+    map_rev++;
+    switch(e->action) {
+        case MAP_MOD: {
+            // XOR delta, so undo and redo are the same operation
+            std::vector<uint8_t> delta(e->map_mod.w * e->map_mod.h);
+            UnpackTileDelta(e->map_mod.delta, e->map_mod.delta_len, delta.data(), delta.size());
+            for(uint16_t y = 0; y < e->map_mod.h; y++) {
+                for(uint16_t x = 0; x < e->map_mod.w; x++) {
+                    uint16_t xx = e->map_mod.x + x;
+                    uint16_t yy = e->map_mod.y + y;
+                    pxm.SetTile(xx, yy, pxm.Tile(xx, yy) ^ delta[y * e->map_mod.w + x]);
+                }
             }
-        } else {
-            strncpy(data, tsc_text, TSC_MAX);
+            break;
         }
-        fwrite(data, 1, len, file);
-        fclose(file);
+        case MAP_SIZE: {
+            uint16_t w = e->map_size.old_w, h = e->map_size.old_h;
+            std::vector<uint8_t> delta(w * h);
+            UnpackTileDelta(e->map_size.delta, e->map_size.delta_len, delta.data(), delta.size());
+            if(!redo) pxm.Resize(w, h);
+            for(uint16_t y = 0; y < h; y++) {
+                for(uint16_t x = 0; x < w; x++) pxm.SetTile(x, y, pxm.Tile(x, y) ^ delta[y * w + x]);
+            }
+            if(redo) pxm.Resize(e->map_size.new_w, e->map_size.new_h);
+            break;
+        }
+        case ENTITY_MOD:
+            pxe.SetEntity(e->entity_mod.index, redo ? e->entity_mod.new_entity : e->entity_mod.old_entity);
+            break;
+        case ENTITY_ADD:
+            if(redo) pxe.AddEntity(e->entity_add.new_entity);
+            else pxe.DeleteEntity(pxe.Size() - 1);
+            selectedEntity = -1;
+            break;
+        case ENTITY_DEL:
+            if(redo) pxe.DeleteEntity(e->entity_del.index);
+            else pxe.InsertEntity(e->entity_del.index, e->entity_del.old_entity);
+            selectedEntity = -1;
+            break;
     }
 }
 
+void StageWindow::Autosave() {
+    Preferences &pref = Preferences::Instance();
+    double now = ImGui::GetTime();
+    if(autosaveBusy || pref.autosaveInterval <= 0 || now - lastAutosave < pref.autosaveInterval) return;
+    lastAutosave = now;
+    // Only files that were opened from or saved to somewhere get a sidecar
+    bool dirtyOnly = pref.autosaveDirtyOnly;
+    bool saveMap = pxm_fname != "untitled.pxm" && (!dirtyOnly || map_rev != autosave_rev[0]);
+    bool saveScript = tsc_fname != "untitled.tsc" && !tsc_text.Empty() && (!dirtyOnly || tsc_rev != autosave_rev[1]);
+    bool saveAttr = pxa_fname != "untitled.pxa" && (!dirtyOnly || pxa_rev != autosave_rev[2]);
+    if(!saveMap && !saveScript && !saveAttr) return;
+    // Snapshot here, the map only copies chunk pointers and the rest is a few KB at most.
+    // Serializing and writing happens on the save worker
+    PXM map = pxm.Snapshot();
+    std::vector<uint8_t> entities, attr;
+    if(saveMap) pxe.Save(entities);
+    ScriptSnapshot script = tsc_text.Snapshot();
+    if(saveAttr) attr.assign(pxa, pxa + min(tileset_width * tileset_height, PXA_MAX));
+    bool obfuscated = tsc_obfuscated;
+    std::string pxmfn = pxm_fname, pxefn = pxe_fname, tscfn = tsc_fname, pxafn = pxa_fname;
+    uint32_t revs[3] = { map_rev, tsc_rev, pxa_rev };
+    autosaveBusy = true;
+    SaveService::Instance().Save([=](std::vector<SaveFile> &files) {
+        if(saveMap) {
+            files.push_back({ pxmfn + AUTOSAVE_EXT, {} });
+            map.Save(files.back().data);
+            files.push_back({ pxefn + AUTOSAVE_EXT, entities });
+        }
+        if(saveScript) {
+            files.push_back({ tscfn + AUTOSAVE_EXT, std::vector<uint8_t>(script.Text(), script.Text() + script.length) });
+            if(obfuscated) TscCodec::EncodeScript(files.back().data.data(), script.length);
+        }
+        if(saveAttr) files.push_back({ pxafn + AUTOSAVE_EXT, attr });
+    }, [this, saveMap, saveScript, saveAttr, revs](bool ok, const std::string &error) {
+        autosaveBusy = false;
+        if(!ok) {
+            SetStatus("Autosave failed: " + error, true);
+            return;
+        }
+        if(saveMap) autosave_rev[0] = max(autosave_rev[0], revs[0]);
+        if(saveScript) autosave_rev[1] = max(autosave_rev[1], revs[1]);
+        if(saveAttr) autosave_rev[2] = max(autosave_rev[2], revs[2]);
+        SetStatus("Autosaved");
+    });
+}
+
 void StageWindow::OpenTileset(std::string fname) {
-    history.Clear();
-    tileset_fname = "";
-    if(tileset_image) FreeTexture(tileset_image);
-    tileset_image = LoadTexture(fname.c_str(), &tileset_width, &tileset_height, true);
-    if(tileset_image) {
-        tileset_fname = fname;
-        tileset_width /= 16;
-        tileset_height /= 16;
-        Preferences::Instance().AddRecentTS(tileset_fname);
-    }
+    ClearHistory();
+    autosave_rev[2] = pxa_rev;
+    uint32_t request = ++tileset_request;
+    // The old tileset stays up until the new image has been decoded and uploaded
+    TextureLoader::Instance().Acquire(fname, true, [this, fname, request](TextureInfo texture) {
+        uint32_t tex = texture.tex;
+        if(request != tileset_request) {
+            if(tex) FreeTexture(tex);
+            return;
+        }
+        tileset_fname = "";
+        if(tileset_image) FreeTexture(tileset_image);
+        tileset_image = tex;
+        if(tileset_image) {
+            tileset_fname = fname;
+            tileset_width = texture.w / 16;
+            tileset_height = texture.h / 16;
+            Preferences::Instance().AddRecentTS(tileset_fname);
+        }
+        selectedTile = 0;
+        tileRange[0] = tileRange[1] = 0;
+        tileRange[2] = tileRange[3] = 1;
+        WatchFiles();
+    });
     // Try to open PXA with the same base name
-    selectedTile = 0;
-    tileRange[0] = tileRange[1] = 0;
-    tileRange[2] = tileRange[3] = 1;
     std::string newfn = fname.substr(0, fname.find_last_of('.')) + ".pxa";
     size_t prt_loc = newfn.find("Prt");
     if(prt_loc != std::string::npos) newfn = newfn.erase(prt_loc, 3);
     //printf("%s\n", newfn.c_str());
-    FILE *file = fopen(newfn.c_str(), "rb");
-    if(file) {
-        pxa_fname = newfn;
-        fread(pxa, 1, min(tileset_width * tileset_height, PXA_MAX), file);
+    ThreadPool::Instance().Submit([this, newfn, request]() {
+        std::vector<uint8_t> data(PXA_MAX, 0);
+        FILE *file = fopen(newfn.c_str(), "rb");
+        if(!file) return;
+        fread(data.data(), 1, PXA_MAX, file);
         fclose(file);
-    }
+        ThreadPool::Instance().RunOnMain([this, newfn, request, data]() {
+            if(request != tileset_request) return;
+            pxa_fname = newfn;
+            memcpy(pxa, data.data(), PXA_MAX);
+            memcpy(pxa_saved, data.data(), PXA_MAX);
+            saved_rev[2] = autosave_rev[2] = pxa_rev;
+            WatchFiles();
+        });
+    });
 }
 
 void StageWindow::SaveTileset() {
-    FILE *file = fopen(pxa_fname.c_str(), "wb");
-    if(file) {
-        fwrite(pxa, 1, tileset_width * tileset_height, file);
-        fclose(file);
+    std::vector<uint8_t> attr(pxa, pxa + min(tileset_width * tileset_height, PXA_MAX));
+    std::string pxafn = pxa_fname;
+    uint32_t rev = pxa_rev;
+    SaveService::Instance().Save([attr, pxafn](std::vector<SaveFile> &files) {
+        files.push_back({ pxafn, attr });
+    }, [this, attr, pxafn, rev](bool ok, const std::string &error) {
+        if(!ok) {
+            SetStatus("Failed to save tile attributes: " + error, true);
+            return;
+        }
+        SetStatus("Saved " + pxafn);
+        if(pxafn != pxa_fname) return;
+        autosave_rev[2] = saved_rev[2] = rev;
+        memcpy(pxa_saved, attr.data(), attr.size());
+        WatchFiles();
+    });
+}
+
+void StageWindow::WatchFiles() {
+    // Names that were never opened from or saved to disk are placeholders
+    auto files = [](const std::string &fname) {
+        return fname.empty() || fname.rfind("untitled.", 0) == 0 ? std::vector<std::string>() : std::vector<std::string> { fname };
+    };
+    watcher.Watch(WATCH_PXM, files(pxm_fname));
+    watcher.Watch(WATCH_PXE, files(pxe_fname));
+    watcher.Watch(WATCH_TSC, files(tsc_fname));
+    watcher.Watch(WATCH_TILESET, files(tileset_fname));
+    watcher.Watch(WATCH_PXA, files(pxa_fname));
+    std::string npc_list = Preferences::Instance().npcListPath;
+    watcher.Watch(WATCH_NPC, npc_sprites.empty() || npc_list.empty() ? std::vector<std::string>() : NpcListSources(npc_list));
+}
+
+void StageWindow::ConfirmDiscard(bool tileset, std::function<void()> action) {
+    if(map_rev == saved_rev[0] && tsc_rev == saved_rev[1] && (!tileset || pxa_rev == saved_rev[2])) {
+        action();
+        return;
     }
+    discard_pending = action;
 }
 
-static std::string SlurpFile(std::filesystem::path path) {
-    std::ifstream f(path, std::ios::in | std::ios::binary);
-    if(!f.is_open()) return {};
-    const auto sz = std::filesystem::file_size(path);
-    std::string result(sz, '\0');
-    f.read(result.data(), sz);
-    return result;
+void StageWindow::ReloadChanged(uint32_t slots) {
+    if(slots & (1 << WATCH_TILESET)) ReloadTilesetImage();
+    if((slots & (1 << WATCH_NPC)) && !npc_sprites.empty()) LoadNpcList(Preferences::Instance().npcListPath);
+    auto reload = std::make_shared<DiskReload>();
+    // Map and entities are saved together, so they are reloaded together too. Opening
+    // a stage reads everything fresh anyway
+    reload->has_map = !loading && (slots & ((1 << WATCH_PXM) | (1 << WATCH_PXE)));
+    reload->has_tsc = !loading && (slots & (1 << WATCH_TSC));
+    reload->has_pxa = (slots & (1 << WATCH_PXA));
+    if(!reload->has_map && !reload->has_tsc && !reload->has_pxa) return;
+    reload->pxm_fname = pxm_fname;
+    reload->pxe_fname = pxe_fname;
+    reload->tsc_fname = tsc_fname;
+    reload->pxa_fname = pxa_fname;
+    ThreadPool::Instance().Submit([this, reload]() {
+        if(reload->has_map) {
+            FILE *file = fopen(reload->pxm_fname.c_str(), "rb");
+            if(file) {
+                reload->pxm.Load(file);
+                fclose(file);
+                file = fopen(reload->pxe_fname.c_str(), "rb");
+            }
+            if(file) {
+                reload->pxe.Load(file);
+                fclose(file);
+            }
+            reload->has_map = file != NULL;
+        }
+        if(reload->has_tsc) reload->has_tsc = TscCodec::Read(reload->tsc_fname, reload->tsc, reload->tsc_obfuscated);
+        if(reload->has_pxa) {
+            memset(reload->pxa, 0, PXA_MAX);
+            FILE *file = fopen(reload->pxa_fname.c_str(), "rb");
+            if(file) {
+                fread(reload->pxa, 1, PXA_MAX, file);
+                fclose(file);
+            }
+            reload->has_pxa = file != NULL;
+        }
+        ThreadPool::Instance().RunOnMain([this, reload]() { FinishReload(reload); });
+    });
 }
 
-void StageWindow::LoadNpcList(std::string fname) {
-    FILE *file = fopen(fname.c_str(), "r");
-    if(file) {
-        size_t pathPos = fname.find("/src/db/npc.c");
-        std::string sheet_str = SlurpFile(fname.substr(0, pathPos) + "/src/sheet.c");
-        std::string res_str = SlurpFile(fname.substr(0, pathPos) + "/res/resources.res");
-        for(auto & s : npc_sprites) {
-            if(s.texture) FreeTexture(s.texture);
-        }
-        npc_sprites.clear();
-        char buf[256];
-        while(fgets(buf, 256, file) != NULL) {
-            // FIXME: This assumes all NPC definitions are a single line
-            char *start = strchr(buf, '{');
-            if(start == NULL) continue;
-            char *end = strchr(buf, '}');
-            if(end == NULL) continue;
-            // This line contains an NPC, check if there is a sprite pointer or sheet
-            char *spr = strstr(start, "&SPR_");
-            char *sht = strstr(start, "SHEET_");
-            if(sht && !spr) {
-                // Have to look in sheet.c to find the sprite variable
-                char *sht_end = strstr(sht, ",");
-                size_t len = sht_end - sht;
-                if(len < 64) {
-                    char sht_var[64];
-                    memcpy(sht_var, sht, len);
-                    sht_var[len] = 0;
-                    //printf("%s\n", sht_var);
-                    size_t shtpos = sheet_str.find(sht_var);
-                    if(shtpos != std::string::npos) {
-                        // Pull SPR var from ADD_SHEET line
-                        std::string line = sheet_str.substr(shtpos);
-                        line = line.substr(0, line.find_first_of("\n\0"));
-                        strncpy(buf, line.c_str(), 256);
-                        buf[min(line.length(),255)] = 0;
-                        //printf("%s\n", buf);
-                        spr = strstr(buf, "&SPR_");
-                    }
-                }
+void StageWindow::FinishReload(std::shared_ptr<DiskReload> reload) {
+    // Drop what no longer matches the open files, and what is the same as the last load or
+    // save (which includes the editor's own saves)
+    DiskReload &r = *reload;
+    r.has_map = r.has_map && !loading && r.pxm_fname == pxm_fname && r.pxe_fname == pxe_fname
+            && !(r.pxm.Equals(pxm_saved) && r.pxe.Equals(pxe_saved));
+    r.has_tsc = r.has_tsc && !loading && r.tsc_fname == tsc_fname
+            && HashBytes(r.tsc.data(), r.tsc.length()) != tsc_saved;
+    r.has_pxa = r.has_pxa && r.pxa_fname == pxa_fname && memcmp(r.pxa, pxa_saved, PXA_MAX) != 0;
+    // Anything with unsaved edits waits for the user, the rest is reloaded right away
+    bool edited[3] = {
+            r.has_map && map_rev != saved_rev[0],
+            r.has_tsc && tsc_rev != saved_rev[1],
+            r.has_pxa && pxa_rev != saved_rev[2],
+    };
+    if(edited[0] || edited[1] || edited[2]) {
+        if(!reload_pending) {
+            reload_pending = std::make_shared<DiskReload>();
+            reload_pending->has_map = reload_pending->has_tsc = reload_pending->has_pxa = false;
+        }
+        DiskReload &p = *reload_pending;
+        if(edited[0]) {
+            p.has_map = true;
+            p.pxm_fname = r.pxm_fname;
+            p.pxe_fname = r.pxe_fname;
+            p.pxm = r.pxm;
+            p.pxe = r.pxe;
+            r.has_map = false;
+        }
+        if(edited[1]) {
+            p.has_tsc = true;
+            p.tsc_fname = r.tsc_fname;
+            p.tsc = r.tsc;
+            p.tsc_obfuscated = r.tsc_obfuscated;
+            r.has_tsc = false;
+        }
+        if(edited[2]) {
+            p.has_pxa = true;
+            p.pxa_fname = r.pxa_fname;
+            memcpy(p.pxa, r.pxa, PXA_MAX);
+            r.has_pxa = false;
+        }
+    }
+    ApplyReload(r);
+}
+
+void StageWindow::ApplyReload(DiskReload &r) {
+    if(r.has_map && r.pxm_fname == pxm_fname) {
+        // Turn the difference into history entries, so the reload can be undone like any edit.
+        // The journal starts over from the reloaded file, so they aren't journaled themselves
+        std::vector<HistEntry*> entries;
+        DiffStage(pxm, pxe, r.pxm, r.pxe, entries);
+        for(auto e : entries) {
+            ApplyHistory(e, true);
+            history.AddEntry(e);
+        }
+        if(selectedEntity >= pxe.Size()) selectedEntity = -1;
+        pxm_saved = r.pxm;
+        pxe_saved = r.pxe;
+        saved_rev[0] = map_rev;
+        journal.Open(pxm_fname, MapHash());
+        SetStatus("Reloaded " + pxm_fname);
+    }
+    if(r.has_tsc && r.tsc_fname == tsc_fname) {
+        tsc_text.Assign(r.tsc.c_str(), r.tsc.length());
+        RebuildScriptIndex();
+        tsc_obfuscated = r.tsc_obfuscated;
+        tsc_saved = HashBytes(r.tsc.data(), r.tsc.length());
+        saved_rev[1] = ++tsc_rev;
+        SetStatus("Reloaded " + tsc_fname);
+    }
+    if(r.has_pxa && r.pxa_fname == pxa_fname) {
+        memcpy(pxa, r.pxa, PXA_MAX);
+        memcpy(pxa_saved, r.pxa, PXA_MAX);
+        saved_rev[2] = ++pxa_rev;
+        SetStatus("Reloaded " + pxa_fname);
+    }
+}
+
+void StageWindow::KeepEdits(DiskReload &r) {
+    // The files on disk become what the edits are compared against, so they still show as unsaved
+    if(r.has_map && r.pxm_fname == pxm_fname) {
+        pxm_saved = r.pxm;
+        pxe_saved = r.pxe;
+        // A crash would replay the journal over the new file, so journal the edits against it
+        RebaseJournal(r.pxm, r.pxe);
+    }
+    if(r.has_tsc && r.tsc_fname == tsc_fname) tsc_saved = HashBytes(r.tsc.data(), r.tsc.length());
+    if(r.has_pxa && r.pxa_fname == pxa_fname) memcpy(pxa_saved, r.pxa, PXA_MAX);
+}
+
+void StageWindow::ReloadTilesetImage() {
+    if(!tileset_image) return;
+    uint32_t request = ++tileset_request;
+    std::string fname = tileset_fname;
+    TextureLoader::Instance().Forget(fname, true);
+    TextureLoader::Instance().Acquire(fname, true, [this, request](TextureInfo texture) {
+        if(request != tileset_request || !texture.tex) {
+            if(texture.tex) FreeTexture(texture.tex);
+            return;
+        }
+        // Same as opening it, except the selection is kept where it still fits
+        FreeTexture(tileset_image);
+        tileset_image = texture.tex;
+        tileset_width = texture.w / 16;
+        tileset_height = texture.h / 16;
+        if(selectedTile >= tileset_width * tileset_height) selectedTile = 0;
+        if(tileRange[0] + tileRange[2] > tileset_width || tileRange[1] + tileRange[3] > tileset_height) {
+            tileRange[0] = tileRange[1] = 0;
+            tileRange[2] = tileRange[3] = 1;
+        }
+        SetStatus("Reloaded " + tileset_fname);
+    });
+}
+
+// Where the game keeps its data: the open project, the directory above the map's Stage/,
+// or the map's own directory
+std::string StageWindow::DataDirectory() const {
+    if(!project.Empty()) return project.Root();
+    if(pxm_fname == "untitled.pxm") return "";
+    std::filesystem::path dir = std::filesystem::path(pxm_fname).parent_path();
+    if(dir.filename() == "Stage") dir = dir.parent_path();
+    return dir.empty() ? "." : dir.generic_string();
+}
+
+void StageWindow::JumpToIssue(const LintIssue &issue) {
+    if(SamePath(issue.fname, tsc_fname)) {
+        tsc_text.JumpTo(issue.pos);
+        ImGui::SetWindowFocus("Script");
+        return;
+    }
+    // Open the map the script goes with, same places OpenMap looks for a map's script
+    std::filesystem::path path(issue.fname), dir = path.parent_path();
+    std::string pxm = path.stem().string() + ".pxm";
+    std::vector<std::filesystem::path> candidates = { dir / pxm };
+    if(dir.filename() == "tsc") candidates.push_back(dir.parent_path() / "Stage" / pxm);
+    for(auto &c : candidates) {
+        std::error_code ec;
+        if(!std::filesystem::exists(c, ec)) continue;
+        std::string fname = issue.fname, map_fname = c.generic_string();
+        size_t pos = issue.pos;
+        ConfirmDiscard(false, [this, fname, pos, map_fname]() {
+            lint_jump_fname = fname;
+            lint_jump_pos = pos;
+            OpenMap(map_fname);
+        });
+        return;
+    }
+    SetStatus("No map goes with " + issue.fname, true);
+}
+
+void StageWindow::RebuildScriptIndex() {
+    tsc_index.Build(tsc_text.Text(), tsc_text.Length());
+    tsc_syntax.Build(tsc_text.Text(), tsc_text.Length());
+    xref.BuildScript(tsc_text.Text(), tsc_text.Length());
+}
+
+bool StageWindow::JumpToEvent(uint16_t event) {
+    const TscEvent *ev = tsc_index.Find(event);
+    if(!ev) {
+        char text[64];
+        if(head_index.Find(event)) {
+            snprintf(text, sizeof(text), "#%04hu is in Head.tsc", event);
+            SetStatus(text);
+            return true;
+        }
+        snprintf(text, sizeof(text), "The script has no #%04hu", event);
+        SetStatus(text, true);
+        return false;
+    }
+    tsc_text.JumpTo(ev->start);
+    ImGui::SetWindowFocus("Script");
+    return true;
+}
+
+// Other entities and script commands sharing the selected entity's event and flag.
+// Returns the entity clicked on, -1 if none was
+int StageWindow::DrawReferences(const Entity &e) {
+    int clicked = -1;
+    auto entities = [&](const std::vector<uint16_t> &list) {
+        for(uint16_t i : list) {
+            if(i == selectedEntity) continue;
+            char label[32];
+            snprintf(label, sizeof(label), "Entity %hu", i);
+            ImGui::SameLine();
+            if(ImGui::SmallButton(label)) clicked = i;
+        }
+    };
+    auto uses = [&](const std::vector<ScriptRef> &list) {
+        static const char *kinds[] = { "Jump", "Set", "Clear", "Test" };
+        for(auto &r : list) {
+            char label[64];
+            snprintf(label, sizeof(label), "%s on line %zu##%u", kinds[r.kind], tsc_syntax.LineAt(r.pos) + 1, r.pos);
+            if(ImGui::Selectable(label)) {
+                tsc_text.JumpTo(r.pos);
+                ImGui::SetWindowFocus("Script");
             }
-            if(spr) {
-                // Sprite variable found, get filename and dimensions from resources.res
-                char *spr_end = strstr(spr, ",");
-                size_t len = spr_end - spr - 1;
-                if(len < 64) {
-                    char spr_var[64];
-                    memcpy(spr_var, spr + 1, len);
-                    spr_var[len] = 0;
-                    size_t respos = res_str.find(spr_var);
-                    if(respos != std::string::npos) {
-                        // Pull filename from line containing SPR var
-                        std::string line = res_str.substr(respos);
-                        line = line.substr(0, line.find_first_of("\n\0"));
-                        std::string spr_fname = line.substr(line.find('"') + 1);
-                        spr_fname = spr_fname.substr(0, spr_fname.rfind('"'));
-                        // Merge res relative path with full path
-                        spr_fname.insert(0, fname.substr(0, pathPos) + "/res/");
-                        if(!spr_fname.empty()) {
-                            // Pull width and height
-                            std::string size_str = trim_copy(line.substr(line.rfind('"') + 1));
-                            int w = std::stoi(size_str, NULL);
-                            int h = std::stoi(size_str.substr(size_str.find_first_of(" \t") + 1), NULL);
-                            //printf("%s: %s - %d, %d\n", spr_var, spr_fname.c_str(), w, h);
-                            if(w > 0 && h > 0) {
-                                NpcSprite sprite;
-                                sprite.texture = LoadTexture(spr_fname.c_str(), &sprite.tex_w, &sprite.tex_h, true);
-                                if(sprite.texture) {
-                                    sprite.fname = spr_fname;
-                                    sprite.frame_w = w;
-                                    sprite.frame_h = h;
-                                    npc_sprites.emplace_back(sprite);
-                                    continue;
-                                }
-                            }
-                        }
-                    }
+        }
+    };
+    const char *where = tsc_index.Find(e.event) ? "" : head_index.Find(e.event) ? " (in Head.tsc)" : " (not in the script)";
+    ImGui::Text("Event #%04hu%s", e.event, where);
+    entities(xref.EventEntities(e.event));
+    ImGui::Indent();
+    uses(xref.ScriptUses(e.event, false));
+    ImGui::Unindent();
+    if(e.flags & (ENTITY_ENABLE_ON_FLAG | ENTITY_DISABLE_ON_FLAG)) {
+        ImGui::Text("Flag %hu", e.id);
+        entities(xref.FlagEntities(e.id));
+        ImGui::Indent();
+        uses(xref.ScriptUses(e.id, true));
+        ImGui::Unindent();
+    }
+    return clicked;
+}
+
+// Events of the open stage nothing uses, and ones used that don't exist
+void StageWindow::DrawStageReport() {
+    std::vector<uint16_t> dangling = xref.DanglingEvents(tsc_index, head_index), unused = xref.UnusedEvents(tsc_index);
+    ImGui::Text("%d missing, %d unused", (int) dangling.size(), (int) unused.size());
+    if(ImGui::BeginTable("##StageReport", 2, ImGuiTableFlags_RowBg | ImGuiTableFlags_ScrollY)) {
+        ImGui::TableSetupScrollFreeze(0, 1);
+        ImGui::TableSetupColumn("Event", ImGuiTableColumnFlags_WidthFixed, 60);
+        ImGui::TableSetupColumn("Problem", ImGuiTableColumnFlags_WidthStretch);
+        ImGui::TableHeadersRow();
+        for(uint16_t event : dangling) {
+            ImGui::TableNextRow();
+            ImGui::TableNextColumn();
+            char label[32];
+            snprintf(label, sizeof(label), "#%04hu##missing", event);
+            if(ImGui::Selectable(label, false, ImGuiSelectableFlags_SpanAllColumns)) {
+                // Show whatever refers to it
+                std::vector<ScriptRef> uses = xref.ScriptUses(event, false);
+                if(!uses.empty()) {
+                    tsc_text.JumpTo(uses[0].pos);
+                    ImGui::SetWindowFocus("Script");
+                } else if(!xref.EventEntities(event).empty()) {
+                    selectedEntity = xref.EventEntities(event)[0];
+                    ImGui::SetWindowFocus("Entity");
                 }
             }
-            // No sprite or failed to find it, add a blank entry
-            NpcSprite sprite;
-            sprite.fname = "";
-            sprite.texture = 0;
-            npc_sprites.emplace_back(sprite);
-        }
-        Preferences::Instance().npcListPath = fname;
-        Preferences::Instance().Save();
-        fclose(file);
+            ImGui::TableNextColumn();
+            ImGui::Text("Used by %d entities and %d commands, not in the script",
+                        (int) xref.EventEntities(event).size(), (int) xref.ScriptUses(event, false).size());
+        }
+        for(uint16_t event : unused) {
+            ImGui::TableNextRow();
+            ImGui::TableNextColumn();
+            char label[32];
+            snprintf(label, sizeof(label), "#%04hu##unused", event);
+            if(ImGui::Selectable(label, false, ImGuiSelectableFlags_SpanAllColumns)) JumpToEvent(event);
+            ImGui::TableNextColumn();
+            ImGui::TextDisabled("Nothing on this stage uses it");
+        }
+        ImGui::EndTable();
     }
 }
 
+void StageWindow::RequireNpcSprites() {
+    if(npc_list_deferred.empty()) return;
+    LoadNpcList(npc_list_deferred);
+}
+
+void StageWindow::LoadNpcList(std::string fname) {
+    npc_list_deferred = "";
+    uint32_t request = ++npc_request;
+    ThreadPool::Instance().Submit([this, fname, request]() {
+        auto sprites = std::make_shared<std::vector<NpcSprite>>();
+        if(!ParseNpcList(fname, *sprites)) return;
+        // Lots of NPCs share a sheet, only ask for each one once
+        std::vector<std::string> sheets;
+        std::unordered_map<std::string, int> sheet_index;
+        std::vector<int> which(sprites->size(), -1);
+        for(size_t i = 0; i < sprites->size(); i++) {
+            const std::string &sheet = (*sprites)[i].fname;
+            if(sheet.empty()) continue;
+            auto it = sheet_index.emplace(sheet, (int) sheets.size());
+            if(it.second) sheets.push_back(sheet);
+            which[i] = it.first->second;
+        }
+        // The texture cache belongs to the render thread
+        ThreadPool::Instance().RunOnMain([this, fname, request, sprites, sheets, which]() {
+            if(request != npc_request) return;
+            TextureLoader::Instance().AcquireBatch(sheets, true, [this, fname, request, sprites, which](std::vector<TextureInfo> textures) {
+                if(request != npc_request) {
+                    for(auto &t : textures) if(t.tex) FreeTexture(t.tex);
+                    return;
+                }
+                for(auto tex : npc_textures) FreeTexture(tex);
+                npc_textures.clear();
+                for(auto &t : textures) if(t.tex) npc_textures.push_back(t.tex);
+                for(size_t i = 0; i < sprites->size(); i++) {
+                    if(which[i] < 0) continue;
+                    NpcSprite &s = (*sprites)[i];
+                    s.texture = textures[which[i]].tex;
+                    s.tex_w = textures[which[i]].w;
+                    s.tex_h = textures[which[i]].h;
+                }
+                npc_sprites.swap(*sprites);
+                Preferences::Instance().npcListPath = fname;
+                Preferences::Instance().Save();
+                WatchFiles();
+            });
+        });
+    });
+}
+
 bool StageWindow::Render() {
     ImGuiIO& io = ImGui::GetIO();
     Preferences &pref = Preferences::Instance();
 
+    ThreadPool::Instance().Pump();
+    TextureLoader::Instance().Pump(TEXTURE_UPLOAD_BUDGET);
+    // Wait until the first frame has been presented
+    if(restore_pending && ImGui::GetFrameCount() > 1) {
+        restore_pending = false;
+        RestoreSession();
+    }
+    uint32_t changed = watcher.Changed();
+    if(changed) ReloadChanged(changed);
+    Autosave();
+    xref.UpdateEntities(pxe);
+
     bool menuExit = false;
     bool popupNewMap = false, popupNewTileset = false, popupPreferences = false;
     ImGui::BeginMainMenuBar();
@@ -601,6 +1396,9 @@ bool StageWindow::Render() {
             if (ImGui::MenuItem("New Map")) {
                 popupNewMap = true;
             }
+            if (ImGui::MenuItem("Open Project...")) {
+                ImGuiFileDialog::Instance()->OpenDialog("OpenProjectDir", "Open Project", NULL, ".");
+            }
             if (ImGui::MenuItem("Open Map...")) {
                 ImGuiFileDialog::Instance()->OpenDialog("OpenMapFile", "Open Map File", ".pxm", ".");
             }
@@ -653,6 +1451,11 @@ bool StageWindow::Render() {
             if (ImGui::MenuItem("Save Tile Attributes")) {
                 SaveTileset();
             }
+            if (ImGui::MenuItem("Save All")) {
+                SaveMap();
+                if(!tsc_text.Empty()) SaveScript();
+                if(tileset_image) SaveTileset();
+            }
             ImGui::Separator();
             if (ImGui::MenuItem("Open NPC List")) {
                 ImGuiFileDialog::Instance()->OpenDialog("OpenNPCList", "Open NPC List", ".c", ".");
@@ -667,13 +1470,19 @@ bool StageWindow::Render() {
             }
             ImGui::EndMenu();
         }
-        //if (ImGui::BeginMenu("Edit")) {
-        //    ImGui::Separator();
-        //    ImGui::RadioButton("Insert Mode", &pref.editMode, EDIT_PENCIL);
-        //    ImGui::RadioButton("Erase Mode", &pref.editMode, EDIT_ERASER);
-        //    ImGui::RadioButton("Entity Mode", &pref.editMode, EDIT_ENTITY);
-        //    ImGui::EndMenu();
-        //}
+        if (ImGui::BeginMenu("Edit")) {
+            if (ImGui::MenuItem("Undo", "Ctrl+Z")) {
+                Undo();
+            }
+            if (ImGui::MenuItem("Redo", "Ctrl+Y")) {
+                Redo();
+            }
+            //ImGui::Separator();
+            //ImGui::RadioButton("Insert Mode", &pref.editMode, EDIT_PENCIL);
+            //ImGui::RadioButton("Erase Mode", &pref.editMode, EDIT_ERASER);
+            //ImGui::RadioButton("Entity Mode", &pref.editMode, EDIT_ENTITY);
+            ImGui::EndMenu();
+        }
         if (ImGui::BeginMenu("View")) {
             ImGui::Checkbox("Show Grid", &pref.showGrid);
             ImGui::Separator();
@@ -683,24 +1492,99 @@ bool StageWindow::Render() {
         }
     }
     ImGui::EndMainMenuBar();
+    // Leave Ctrl+Z alone while typing, the script editor has its own undo
+    if (io.KeyCtrl && !io.WantTextInput) {
+        if (ImGui::IsKeyPressed(ImGui::GetKeyIndex(ImGuiKey_Z))) {
+            Undo();
+        }
+        if (ImGui::IsKeyPressed(ImGui::GetKeyIndex(ImGuiKey_Y))) {
+            Redo();
+        }
+    }
     // Workaround for https://github.com/ocornut/imgui/issues/331
     if (popupNewMap) ImGui::OpenPopup("New Map");
     if (popupNewTileset) ImGui::OpenPopup("New Tileset");
     if (popupPreferences) ImGui::OpenPopup("Preferences");
+    if (!journal_records.empty() && !ImGui::IsPopupOpen("Recover Changes")) ImGui::OpenPopup("Recover Changes");
+    if (reload_pending && journal_records.empty() && !ImGui::IsPopupOpen("Changed on Disk")) ImGui::OpenPopup("Changed on Disk");
+    if (discard_pending && !ImGui::IsPopupOpen("Unsaved Changes")) ImGui::OpenPopup("Unsaved Changes");
+
+    if (reload_pending && ImGui::BeginPopupModal("Changed on Disk", NULL, ImGuiWindowFlags_AlwaysAutoResize)) {
+        ImGui::Text("These files were changed by another program, but also have unsaved edits here:");
+        if (reload_pending->has_map) ImGui::BulletText("%s", reload_pending->pxm_fname.c_str());
+        if (reload_pending->has_tsc) ImGui::BulletText("%s", reload_pending->tsc_fname.c_str());
+        if (reload_pending->has_pxa) ImGui::BulletText("%s", reload_pending->pxa_fname.c_str());
+        ImGui::Text("Map changes from reloading can be undone.");
+        if (ImGui::Button("Reload")) {
+            ApplyReload(*reload_pending);
+            reload_pending.reset();
+            ImGui::CloseCurrentPopup();
+        }
+        ImGui::SameLine();
+        if (ImGui::Button("Keep My Edits")) {
+            KeepEdits(*reload_pending);
+            reload_pending.reset();
+            ImGui::CloseCurrentPopup();
+        }
+        ImGui::EndPopup();
+    }
+
+    if (discard_pending && ImGui::BeginPopupModal("Unsaved Changes", NULL, ImGuiWindowFlags_AlwaysAutoResize)) {
+        ImGui::Text("Unsaved changes will be lost. Are you sure?");
+        if (ImGui::Button("Discard Changes")) {
+            auto action = std::move(discard_pending);
+            discard_pending = nullptr;
+            action();
+            ImGui::CloseCurrentPopup();
+        }
+        ImGui::SameLine();
+        if (ImGui::Button("Cancel")) {
+            discard_pending = nullptr;
+            ImGui::CloseCurrentPopup();
+        }
+        ImGui::EndPopup();
+    }
+
+    if (ImGui::BeginPopupModal("Recover Changes", NULL, ImGuiWindowFlags_AlwaysAutoResize)) {
+        ImGui::Text("Found %d unsaved edits to %s from a previous session.",
+                    (int) journal_records.size(), pxm_fname.c_str());
+        if (journal_hash != MapHash()) {
+            ImGui::Text("The map has changed on disk since then, replaying them may give the wrong result.");
+        }
+        if (ImGui::Button("Replay Edits")) {
+            ReplayJournal();
+            ImGui::CloseCurrentPopup();
+        }
+        ImGui::SameLine();
+        if (ImGui::Button("Discard")) {
+            DiscardJournal();
+            ImGui::CloseCurrentPopup();
+        }
+        ImGui::EndPopup();
+    }
 
     if (ImGui::BeginPopup("New Map")) {
         ImGui::Text("Unsaved changes will be lost. Are you sure?");
         if (ImGui::Button("Discard Changes")) {
+            loading.reset();
             history.Clear();
+            journal.Close();
             selectedEntity = -1;
             pxm_fname = "untitled.pxm";
             pxe_fname = "untitled.pxe";
             tsc_fname = "untitled.tsc";
             pxm.Resize(20, 15);
             pxm.Clear();
+            pxm_saved = pxm.Snapshot();
             pxe.Resize(1);
             pxe.Clear();
-            tsc_text[0] = 0;
+            pxe_saved = pxe;
+            tsc_text.Clear();
+            RebuildScriptIndex();
+            tsc_saved = HashBytes("", 0);
+            saved_rev[0] = map_rev;
+            saved_rev[1] = tsc_rev;
+            WatchFiles();
             ImGui::CloseCurrentPopup();
         }
         ImGui::SameLine();
@@ -709,6 +1593,12 @@ bool StageWindow::Render() {
         }
         ImGui::EndPopup();
     }
+    if (ImGuiFileDialog::Instance()->Display("OpenProjectDir")) {
+        if (ImGuiFileDialog::Instance()->IsOk()) {
+            OpenProject(ImGuiFileDialog::Instance()->GetCurrentPath());
+            ImGuiFileDialog::Instance()->Close();
+        }
+    }
     if (ImGuiFileDialog::Instance()->Display("OpenMapFile")) {
         if (ImGuiFileDialog::Instance()->IsOk()) {
             OpenMap(ImGuiFileDialog::Instance()->GetFilePathName());
@@ -733,16 +1623,21 @@ bool StageWindow::Render() {
     if (ImGui::BeginPopup("New Tileset")) {
         ImGui::Text("Unsaved changes will be lost. Are you sure?");
         if (ImGui::Button("Discard Changes")) {
-            history.Clear();
+            ClearHistory();
             selectedTile = 0;
             tileRange[0] = tileRange[1] = 0;
             tileRange[2] = tileRange[3] = 1;
+            tileset_request++;
+            if(tileset_image) FreeTexture(tileset_image);
             tileset_image = 0;
             tileset_width = 0;
             tileset_height = 0;
             tileset_fname = "untitled.png";
             pxa_fname = "untitled.pxa";
             memset(pxa, 0, PXA_MAX);
+            memset(pxa_saved, 0, PXA_MAX);
+            saved_rev[2] = pxa_rev;
+            WatchFiles();
             ImGui::CloseCurrentPopup();
         }
         ImGui::SameLine();
@@ -772,6 +1667,11 @@ bool StageWindow::Render() {
                 ImGui::ColorPicker4("Color", pref.backColor, ImGuiColorEditFlags_NoAlpha);
             }
         }
+        if(ImGui::CollapsingHeader("Autosave")) {
+            ImGui::InputInt("Interval (seconds, 0 = off)", &pref.autosaveInterval, 10, 60);
+            if(pref.autosaveInterval < 0) pref.autosaveInterval = 0;
+            ImGui::Checkbox("Only save files that changed", &pref.autosaveDirtyOnly);
+        }
         //if(ImGui::CollapsingHeader("File Management")) {
         //    ImGui::Checkbox("Auto load PXE when opening PXM", &pref.autoPXE);
         //    ImGui::Checkbox("Auto load TSC when opening PXM", &pref.autoTSC);
@@ -850,7 +1750,7 @@ bool StageWindow::Render() {
             // Otherwise, when the map is wider than the window, clicking the tileset area will also click the map
             ImVec2 wmin = ImGui::GetWindowPos();
             ImVec2 wmax = ImVec2(wmin.x + ImGui::GetWindowWidth(), wmin.y + ImGui::GetWindowHeight());
-            if(ImGui::IsWindowFocused() && ImGui::IsMouseHoveringRect(wmin, wmax) &&
+            if(ImGui::IsWindowFocused() && !loading && ImGui::IsMouseHoveringRect(wmin, wmax) &&
                 map_tile_x >= 0 && map_tile_x < pxm.Width() && map_tile_y >= 0 && map_tile_y < pxm.Height()) {
                 glBindTexture(GL_TEXTURE_2D, white_tex);
                 switch(pref.editMode) {
@@ -867,7 +1767,8 @@ bool StageWindow::Render() {
                             e->map_mod.h = tileRange[3];
                             e->map_mod.tx = tileRange[0];
                             e->map_mod.ty = tileRange[1];
-                            e->map_mod.old_data = (uint16_t*) malloc(tileRange[2] * tileRange[3] * sizeof(uint16_t));
+                            std::vector<uint8_t> old_tiles(tileRange[2] * tileRange[3]);
+                            std::vector<uint8_t> new_tiles(tileRange[2] * tileRange[3]);
                             // Place rect of tiles
                             for (int y = 0; y < tileRange[3]; y++) {
                                 for (int x = 0; x < tileRange[2]; x++) {
@@ -875,13 +1776,19 @@ bool StageWindow::Render() {
                                     uint16_t yy = map_tile_y + y;
                                     uint16_t tx = tileRange[0] + x;
                                     uint16_t ty = tileRange[1] + y;
-                                    e->map_mod.old_data[y * tileRange[2] + x] = pxm.Tile(xx, yy);
+                                    old_tiles[y * tileRange[2] + x] = pxm.Tile(xx, yy);
                                     if (xx < pxm.Width() && yy < pxm.Height()) {
                                         pxm.SetTile(xx, yy, ty * tileset_width + tx);
                                     }
+                                    new_tiles[y * tileRange[2] + x] = pxm.Tile(xx, yy);
                                 }
                             }
-                            history.AddEntry(e);
+                            // Holding the mouse over the same spot stamps the same tiles every frame,
+                            // don't fill the undo list with entries that changed nothing
+                            e->map_mod.delta = PackTileDelta(old_tiles.data(), new_tiles.data(),
+                                                             old_tiles.size(), &e->map_mod.delta_len);
+                            if(e->map_mod.delta) AddHistory(e);
+                            else free(e);
                         }
                         break;
                     case EDIT_ENTITY: // Select Entity
@@ -1001,7 +1908,7 @@ bool StageWindow::Render() {
             if(map_w > 255) map_w = 255;
             if(map_h > 255) map_h = 255;
             if(map_w != pxm.Width() || map_h != pxm.Height()) {
-                pxm.Resize(map_w, map_h);
+                ResizeMap(map_w, map_h);
             }
         }
 
@@ -1070,7 +1977,10 @@ bool StageWindow::Render() {
             ImGui::InputInt("X", &x, 1, 10);
             ImGui::InputInt("Y", &y, 1, 10);
             ImGui::InputInt("ID", &id, 1, 10);
-            ImGui::InputInt("EV", &ev, 1, 10);
+            ImGui::InputInt("##EV", &ev, 1, 10);
+            ImGui::SameLine(0, ImGui::GetStyle().ItemInnerSpacing.x);
+            if(ImGui::SmallButton("EV")) JumpToEvent(e.event);
+            if(ImGui::IsItemHovered()) ImGui::SetTooltip("Jump to the event in the script");
             ImGui::InputInt("NPC", &npc, 1, 10);
             e.x = std::clamp(x, 0, pxm.Width() - 1);
             e.y = std::clamp(y, 0, pxm.Height() - 1);
@@ -1111,6 +2021,7 @@ bool StageWindow::Render() {
             }
             pxe.SetEntity(selectedEntity, e);
             if(ImGui::CollapsingHeader("Sprite Preview")) {
+                RequireNpcSprites();
                 if(!pref.npcListPath.empty() && npc_sprites.size() > e.type) {
                     NpcSprite s = npc_sprites[e.type];
                     if (s.texture) {
@@ -1123,34 +2034,29 @@ bool StageWindow::Render() {
                 }
             }
             if(ImGui::CollapsingHeader("Script Preview")) {
-                char look_for[8];
-                snprintf(look_for, 8, "#%04hu", pxe.GetEntity(selectedEntity).event);
-                std::string tsc = tsc_text;
-                size_t pos = tsc.find(look_for);
-                if(pos != std::string::npos && (pos == 0 || (pos > 0 && tsc[pos-1] == '\n'))) {
-                    char tsc_cut[1024];
-                    int i = 0;
-                    for(; i < 1023; i++) {
-                        if(pos >= tsc.length()) break;
-                        if(tsc[pos] == '#' && i > 0 && tsc[pos-1] == '\n') break;
-                        if(tsc[pos] == '\n' && i > 0 && tsc[pos-1] == '\n') break;
-                        tsc_cut[i] = tsc[pos++];
-                    }
-                    tsc_cut[i] = 0;
-                    ImGui::Text("%s", tsc_cut);
+                const TscEvent *ev = tsc_index.Find(pxe.GetEntity(selectedEntity).event);
+                if(ev) {
+                    // Stop at the first blank line, like the game's own scripts separate branches
+                    const char *text = tsc_text.Text() + ev->start;
+                    size_t len = 1;
+                    while(len < min(ev->end - ev->start, 1023) && !(text[len] == '\n' && text[len - 1] == '\n')) len++;
+                    ImGui::TextUnformatted(text, text + len);
+                    if(ImGui::Button("Jump to Event")) JumpToEvent(ev->event);
                 }
             }
+            // Selecting another entity waits until this one's edits are recorded
+            int clicked = ImGui::CollapsingHeader("References") ? DrawReferences(e) : -1;
             if(markForDelete) {
                 // Store in undo list
                 HistEntry *entry = (HistEntry*) malloc(sizeof(HistEntry));
                 entry->action = ENTITY_DEL;
                 memcpy(&entry->entity_del.old_entity, &old_e, sizeof(Entity));
                 entry->entity_del.index = selectedEntity;
-                history.AddEntry(entry);
                 // Delete entity
                 newEntityX = e.x;
                 newEntityY = e.y;
                 pxe.DeleteEntity(selectedEntity);
+                AddHistory(entry);
                 selectedEntity = -1;
             } else if(memcmp(&e, &old_e, sizeof(Entity)) != 0) {
                 // Entity was modified, store in undo list
@@ -1158,8 +2064,10 @@ bool StageWindow::Render() {
                 entry->action = ENTITY_MOD;
                 memcpy(&entry->entity_mod.old_entity, &old_e, sizeof(Entity));
                 memcpy(&entry->entity_mod.new_entity, &e, sizeof(Entity));
-                history.AddEntry(entry);
+                entry->entity_mod.index = selectedEntity;
+                AddHistory(entry);
             }
+            if(clicked >= 0) selectedEntity = clicked;
         } else {
             ImGui::Text("No entity selected.");
             if(ImGui::Button("Create entity here")) {
@@ -1170,7 +2078,7 @@ bool StageWindow::Render() {
                 HistEntry *entry = (HistEntry*) malloc(sizeof(HistEntry));
                 entry->action = ENTITY_ADD;
                 memcpy(&entry->entity_add.new_entity, &e, sizeof(Entity));
-                history.AddEntry(entry);
+                AddHistory(entry);
             }
         }
     }
@@ -1178,8 +2086,79 @@ bool StageWindow::Render() {
 
     ImGui::Begin("Script", NULL, ImGuiWindowFlags_NoFocusOnAppearing | ImGuiWindowFlags_NoMove);
     {
-        if(tsc_text[0]) {
-            ImGui::InputTextMultiline("##ScriptEdit", tsc_text, TSC_MAX, ImGui::GetContentRegionAvail());
+        if(!tsc_text.Empty()) {
+            // Text is drawn by tsc_syntax in colour, on top of the editor
+            ImGui::PushStyleColor(ImGuiCol_Text, IM_COL32(0, 0, 0, 0));
+            bool edited = tsc_text.Edit("##ScriptEdit", ImGui::GetContentRegionAvail());
+            ImGui::PopStyleColor();
+            if(edited) {
+                tsc_index.Update(tsc_text.Text(), tsc_text.Length(), tsc_text.LastEdit());
+                xref.UpdateScript(tsc_text.Text(), tsc_text.Length(), tsc_text.LastEdit());
+                tsc_syntax.Update(tsc_text.Text(), tsc_text.Length(), tsc_text.LastEdit());
+                tsc_rev++;
+            }
+            tsc_syntax.Draw("##ScriptEdit", tsc_text.Text());
+        }
+    }
+    ImGui::End();
+
+    ImGui::Begin("Stages", NULL, ImGuiWindowFlags_NoFocusOnAppearing | ImGuiWindowFlags_NoMove);
+    DrawStageBrowser();
+    ImGui::End();
+
+    ImGui::Begin("Script Check", NULL, ImGuiWindowFlags_NoFocusOnAppearing | ImGuiWindowFlags_NoMove);
+    {
+        if(ImGui::BeginTabBar("##ScriptCheckTabs")) {
+            if(ImGui::BeginTabItem("This Stage")) {
+                DrawStageReport();
+                ImGui::EndTabItem();
+            }
+            if(ImGui::BeginTabItem("All Scripts")) {
+                std::string dir = DataDirectory();
+                ImGui::BeginDisabled(dir.empty() || linter.Running());
+                if(ImGui::Button("Check All Scripts")) linter.Start(dir);
+                ImGui::EndDisabled();
+                ImGui::SameLine();
+                if(linter.Running()) {
+                    ImGui::Text("Checking %d / %d...", linter.Checked(), linter.Total());
+                } else if(linter.Total() > 0) {
+                    ImGui::Text("%d problems in %d scripts (%.0f ms)", (int) linter.Issues().size(), linter.Total(),
+                                linter.Seconds() * 1000);
+                } else {
+                    ImGui::TextDisabled("%s", dir.empty() ? "Open a map first" : dir.c_str());
+                }
+                const std::vector<LintIssue> &issues = linter.Issues();
+                if(ImGui::BeginTable("##LintIssues", 3, ImGuiTableFlags_RowBg | ImGuiTableFlags_Resizable | ImGuiTableFlags_ScrollY)) {
+                    ImGui::TableSetupScrollFreeze(0, 1);
+                    ImGui::TableSetupColumn("Script", ImGuiTableColumnFlags_WidthFixed, 120);
+                    ImGui::TableSetupColumn("Line", ImGuiTableColumnFlags_WidthFixed, 40);
+                    ImGui::TableSetupColumn("Problem", ImGuiTableColumnFlags_WidthStretch);
+                    ImGui::TableHeadersRow();
+                    ImGuiListClipper clipper;
+                    clipper.Begin((int) issues.size());
+                    int clicked = -1;
+                    while(clipper.Step()) {
+                        for(int i = clipper.DisplayStart; i < clipper.DisplayEnd; i++) {
+                            const LintIssue &issue = issues[i];
+                            ImGui::TableNextRow();
+                            ImGui::TableNextColumn();
+                            ImGui::PushID(i);
+                            size_t subpos = issue.fname.find_last_of('/');
+                            subpos = subpos == std::string::npos ? 0 : subpos + 1;
+                            if(ImGui::Selectable(issue.fname.c_str() + subpos, false, ImGuiSelectableFlags_SpanAllColumns)) clicked = i;
+                            ImGui::PopID();
+                            ImGui::TableNextColumn();
+                            ImGui::Text("%u", issue.line);
+                            ImGui::TableNextColumn();
+                            ImGui::TextUnformatted(issue.message.c_str());
+                        }
+                    }
+                    ImGui::EndTable();
+                    if(clicked >= 0) JumpToIssue(issues[clicked]);
+                }
+                ImGui::EndTabItem();
+            }
+            ImGui::EndTabBar();
         }
     }
     ImGui::End();
@@ -1189,10 +2168,14 @@ bool StageWindow::Render() {
     ImGui::SetNextWindowClass(&winclass);
     ImGui::Begin("Status", NULL, ImGuiWindowFlags_NoMove);
     {
+        if(loading) {
+            ImGui::ProgressBar(float(loading->progress) / STAGE_LOAD_STEPS, ImVec2(120, 0), "Loading...");
+            ImGui::SameLine();
+        }
         // PXM
         size_t subpos = pxm_fname.find_last_of('/');
         if(subpos) subpos++;
-        ImGui::Text("%s", pxm_fname.substr(subpos).c_str());
+        ImGui::Text("%s%s", pxm_fname.substr(subpos).c_str(), pxm.Equals(pxm_saved) ? "" : "*");
         ImGui::SameLine();
         if(map_tile_x >= 0 && map_tile_x < pxm.Width() && map_tile_y >= 0 && map_tile_y < pxm.Height()) {
             ImGui::Text("[%03d, %03d]", map_tile_x, map_tile_y);
@@ -1237,6 +2220,11 @@ bool StageWindow::Render() {
         subpos = pxa_fname.find_last_of('/');
         if(subpos) subpos++;
         ImGui::Text("%s", pxa_fname.substr(subpos).c_str());
+        if(!status_text.empty()) {
+            ImGui::SameLine();
+            if(status_error) ImGui::TextColored(ImVec4(1, 0.4f, 0.4f, 1), "- %s", status_text.c_str());
+            else ImGui::Text("- %s", status_text.c_str());
+        }
     }
     ImGui::End();
 
@@ -4,16 +4,47 @@
 #include "pxm.h"
 #include "PXE.h"
 #include "History.h"
+#include "Journal.h"
+#include "NpcList.h"
+#include "FileWatcher.h"
+#include "ScriptBuffer.h"
+#include "TscIndex.h"
+#include "TscSyntax.h"
+#include "TscLint.h"
+#include "CrossRef.h"
+#include "Project.h"
+#include "Thumbnails.h"
 
 #define PXA_MAX 256
-#define TSC_MAX 0x8000
 
+// Everything opening a stage reads from disk, filled in by a worker and swapped in on the main thread
 typedef struct {
-    std::string fname;
-    uint32_t texture;
-    int tex_w, tex_h;
-    int frame_w, frame_h;
-} NpcSprite;
+    std::string pxm_fname, pxe_fname, tsc_fname;
+    bool has_pxm, has_pxe, has_tsc;
+    PXM pxm;
+    PXE pxe;
+    std::string tsc;
+    bool tsc_obfuscated;
+    std::string head_fname;
+    TscIndex head_index;
+    uint32_t journal_hash;
+    std::vector<JournalRecord> journal_records;
+    std::atomic<int> progress; // Out of STAGE_LOAD_STEPS
+    std::chrono::steady_clock::time_point started;
+} StageLoad;
+
+#define STAGE_LOAD_STEPS 4
+
+// Files that changed on disk, read back by a worker. Only the has_ parts are filled in
+typedef struct {
+    std::string pxm_fname, pxe_fname, tsc_fname, pxa_fname;
+    bool has_map, has_tsc, has_pxa;
+    PXM pxm;
+    PXE pxe;
+    std::string tsc;
+    bool tsc_obfuscated;
+    uint8_t pxa[PXA_MAX];
+} DiskReload;
 
 extern const char *vertex_src;
 extern const char *fragment_src;
@@ -27,6 +58,18 @@ public:
 
 private:
     History history;
+    Journal journal;
+    std::vector<JournalRecord> journal_records; // Waiting for the user to replay or discard
+    uint32_t journal_hash;
+    void AddHistory(HistEntry *e);
+    void Undo();
+    void Redo();
+    void ClearHistory();
+    uint32_t MapHash();
+    // Restarts the journal from base, with the edits since then as records
+    void RebaseJournal(const PXM &base_pxm, const PXE &base_pxe);
+    void ReplayJournal();
+    void DiscardJournal();
     uint32_t white_tex;
     uint32_t back_tex;
     void SetDefaultFB();
@@ -35,7 +78,6 @@ private:
     void DrawUnfilledRect(float x, float y, float w, float h, uint32_t color);
     void DrawGrid(int xx, int yy);
     void DrawBack(int xx, int yy);
-    uint32_t LoadTexture(const char *fname, int *w, int *h, bool transparent = false);
     void FreeTexture(uint32_t tex);
 
     // Map
@@ -43,8 +85,17 @@ private:
     std::string pxe_fname;
     std::string tsc_fname;
     PXM pxm;
+    PXM pxm_saved; // Snapshot of the map as it is on disk
     PXE pxe;
-    char tsc_text[TSC_MAX];
+    ScriptBuffer tsc_text;
+    TscIndex tsc_index;
+    TscSyntax tsc_syntax;
+    TscIndex head_index; // Head.tsc's events, every stage can run them
+    CrossRef xref;
+    void RebuildScriptIndex(); // After replacing the whole script
+    bool JumpToEvent(uint16_t event);
+    int DrawReferences(const Entity &e);
+    void DrawStageReport();
     uint32_t map_fb, map_tex;
     uint16_t lastMapW, lastMapH;
     int selectedEntity;
@@ -53,9 +104,56 @@ private:
     void CreateMapFB(int w, int h);
     void FreeMapFB();
     void SetMapFB() const;
+    std::shared_ptr<StageLoad> loading; // Stage currently being opened, if any
     void OpenMap(std::string fname);
+    void FinishOpenMap(std::shared_ptr<StageLoad> load);
     void SaveMap();
     void SaveScript();
+    void ResizeMap(uint16_t w, uint16_t h);
+    void ApplyHistory(HistEntry *e, bool redo);
+
+    // Autosave
+    uint32_t map_rev, tsc_rev, pxa_rev; // Bumped on every edit
+    uint32_t autosave_rev[3]; // Revisions the sidecar files were last written at
+    double lastAutosave;
+    bool autosaveBusy;
+    std::string status_text;
+    bool status_error;
+    void SetStatus(const std::string &text, bool error = false);
+    void Autosave();
+
+    // Reloading files changed outside the editor
+    FileWatcher watcher;
+    PXE pxe_saved;
+    uint32_t tsc_saved; // Hash of the script
+    uint8_t pxa_saved[PXA_MAX]; // What is on disk, as of the last load or save
+    uint32_t saved_rev[3]; // map_rev, tsc_rev and pxa_rev at that point
+    std::shared_ptr<DiskReload> reload_pending; // Changes that would overwrite unsaved edits, waiting on the user
+    std::function<void()> discard_pending; // Opening something else over unsaved edits, waiting on the user
+    // Runs the action now, or once the user agrees to lose unsaved map and script edits (and tileset ones if it replaces the tileset)
+    void ConfirmDiscard(bool tileset, std::function<void()> action);
+    void WatchFiles();
+    void ReloadChanged(uint32_t slots);
+    void FinishReload(std::shared_ptr<DiskReload> reload);
+    void ApplyReload(DiskReload &reload);
+    void KeepEdits(DiskReload &reload);
+    void ReloadTilesetImage();
+
+    // Every stage of the game's data directory
+    Project project;
+    Thumbnails thumbnails;
+    bool stage_thumbnails; // Grid of map previews instead of the table
+    void OpenProject(const std::string &dir);
+    void OpenStage(const ProjectStage &stage);
+    void DrawStageBrowser();
+    void DrawStageGrid(const std::vector<const ProjectStage*> &shown);
+
+    // Checking every script of the game the map is from
+    TscLinter linter;
+    std::string lint_jump_fname; // Script to jump into once the map opening for it has loaded
+    size_t lint_jump_pos;
+    std::string DataDirectory() const;
+    void JumpToIssue(const LintIssue &issue);
 
     // Tileset
     std::string tileset_fname;
@@ -65,6 +163,7 @@ private:
     int tileset_width, tileset_height;
     uint8_t pxa[PXA_MAX];
     uint16_t tileRange[4], selectedTile;
+    uint32_t tileset_request; // Bumped so a superseded tileset load is dropped when it finishes
     void CreateTilesetFB();
     void FreeTilesetFB();
     void SetTilesetFB() const;
@@ -73,7 +172,15 @@ private:
 
     // NPC List
     std::vector<NpcSprite> npc_sprites;
+    std::vector<uint32_t> npc_textures; // Each sheet once, npc_sprites entries share them
+    uint32_t npc_request;
+    std::string npc_list_deferred; // Loaded the first time something draws a sprite
     void LoadNpcList(std::string fname);
+    void RequireNpcSprites();
+
+    // The last session is reopened after the first frame is up, not in the constructor
+    bool restore_pending;
+    void RestoreSession();
 
     // Shader and VAO
     uint32_t vao;
@@ -0,0 +1,222 @@
+#include "common.h"
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "imgui/stb_image.h"
+#include "glad.h"
+
+#include "ThreadPool.h"
+#include "TextureLoader.h"
+#include "ImageCache.h"
+
+bool TextureLoader::Decode(const std::string &fname, bool transparent, Image &img) {
+    if(ImageCache::Instance().Fetch(fname, transparent, img)) return true;
+    img.w = img.h = 0;
+    FILE *file = fopen(fname.c_str(), "rb");
+    if(!file) return false;
+    stbi_uc *rgba_data = stbi_load_from_file(file, &img.w, &img.h, NULL, STBI_rgb_alpha);
+    fclose(file);
+    if(!rgba_data) return false;
+    if(transparent) {
+        auto pixels = (uint32_t*) rgba_data;
+        uint32_t tcolor = pixels[0];
+        for(int i = 0; i < img.w * img.h; i++) if(pixels[i] == tcolor) pixels[i] = 0;
+    }
+    img.rgba.assign(rgba_data, rgba_data + img.w * img.h * 4);
+    stbi_image_free(rgba_data);
+    ImageCache::Instance().Store(fname, transparent, img);
+    return true;
+}
+
+uint32_t TextureLoader::Upload(const Image &img) {
+    uint32_t texid = 0;
+    glGenTextures(1, &texid);
+    glBindTexture(GL_TEXTURE_2D, texid);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, img.w, img.h, 0, GL_RGBA, GL_UNSIGNED_BYTE, img.rgba.data());
+    return texid;
+}
+
+void TextureLoader::Load(const std::string &fname, bool transparent, std::function<void(uint32_t tex, int w, int h)> done) {
+    ThreadPool::Instance().Submit([this, fname, transparent, done]() {
+        Pending p;
+        p.ok = Decode(fname, transparent, p.img);
+        p.done = done;
+        std::lock_guard<std::mutex> lock(mutex);
+        ready.push_back(std::move(p));
+    });
+}
+
+void TextureLoader::LoadBatch(const std::vector<std::string> &fnames, bool transparent,
+                              std::function<void(std::vector<TextureInfo> textures)> done) {
+    typedef struct {
+        std::vector<Pending> items;
+        std::vector<TextureInfo> textures;
+        std::atomic<size_t> decoding;
+        size_t uploaded;
+        std::function<void(std::vector<TextureInfo> textures)> done;
+    } Batch;
+    if(fnames.empty()) {
+        ThreadPool::Instance().RunOnMain([done]() { done({}); });
+        return;
+    }
+    auto batch = std::make_shared<Batch>();
+    batch->items.resize(fnames.size());
+    batch->textures.resize(fnames.size());
+    batch->decoding = fnames.size();
+    batch->uploaded = 0;
+    batch->done = done;
+    for(size_t i = 0; i < fnames.size(); i++) {
+        ThreadPool::Instance().Submit([this, batch, i, fname = fnames[i], transparent]() {
+            Pending &p = batch->items[i];
+            p.ok = Decode(fname, transparent, p.img);
+            // Only touched by Pump() on the render thread
+            p.done = [batch, i](uint32_t tex, int w, int h) {
+                batch->textures[i] = { tex, w, h };
+                if(++batch->uploaded == batch->textures.size()) batch->done(batch->textures);
+            };
+            if(--batch->decoding > 0) return;
+            std::lock_guard<std::mutex> lock(mutex);
+            for(auto &item : batch->items) ready.push_back(std::move(item));
+        });
+    }
+}
+
+void TextureLoader::Queue(Image img, std::function<void(uint32_t tex, int w, int h)> done) {
+    Pending p;
+    p.ok = true;
+    p.img = std::move(img);
+    p.done = done;
+    std::lock_guard<std::mutex> lock(mutex);
+    ready.push_back(std::move(p));
+}
+
+void TextureLoader::Pump(size_t budget) {
+    size_t sent = 0;
+    while(true) {
+        Pending p;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            // Always upload at least one image, or a big one would never fit
+            if(ready.empty() || (sent > 0 && sent + ready.front().img.rgba.size() > budget)) break;
+            p = std::move(ready.front());
+            ready.pop_front();
+        }
+        uint32_t tex = 0;
+        if(p.ok) {
+            tex = Upload(p.img);
+            sent += p.img.rgba.size();
+        }
+        if(p.done) p.done(tex, p.img.w, p.img.h);
+    }
+}
+
+std::string TextureLoader::CacheKey(const std::string &fname, bool transparent) {
+    return (transparent ? "T:" : "O:") + fname;
+}
+
+void TextureLoader::Loaded(const std::string &key, TextureInfo info) {
+    auto it = cache.find(key);
+    if(it == cache.end()) return;
+    auto waiters = std::move(it->second.waiters);
+    if(info.tex) {
+        it->second.info = info;
+        it->second.loading = false;
+        cache_keys[info.tex] = key;
+    } else {
+        // Don't remember failures, the file might be fixed by the next time it is asked for
+        cache.erase(it);
+    }
+    for(auto &w : waiters) w(info);
+}
+
+void TextureLoader::Acquire(const std::string &fname, bool transparent, std::function<void(TextureInfo texture)> done) {
+    std::string key = CacheKey(fname, transparent);
+    auto it = cache.find(key);
+    if(it != cache.end()) {
+        it->second.refs++;
+        if(it->second.loading) {
+            it->second.waiters.push_back(done);
+        } else {
+            TextureInfo info = it->second.info;
+            ThreadPool::Instance().RunOnMain([done, info]() { done(info); });
+        }
+        return;
+    }
+    CacheEntry &e = cache[key];
+    e.refs = 1;
+    e.loading = true;
+    e.waiters.push_back(done);
+    Load(fname, transparent, [this, key](uint32_t tex, int w, int h) { Loaded(key, { tex, w, h }); });
+}
+
+void TextureLoader::AcquireBatch(const std::vector<std::string> &fnames, bool transparent,
+                                 std::function<void(std::vector<TextureInfo> textures)> done) {
+    typedef struct {
+        std::vector<TextureInfo> textures;
+        size_t remaining;
+        std::function<void(std::vector<TextureInfo> textures)> done;
+    } Result;
+    auto result = std::make_shared<Result>();
+    result->textures.resize(fnames.size());
+    result->remaining = fnames.size();
+    result->done = done;
+    // Only what isn't cached or already on its way gets decoded
+    std::vector<std::string> decode, keys;
+    for(size_t i = 0; i < fnames.size(); i++) {
+        auto waiter = [result, i](TextureInfo texture) {
+            result->textures[i] = texture;
+            if(--result->remaining == 0) result->done(result->textures);
+        };
+        std::string key = CacheKey(fnames[i], transparent);
+        auto it = cache.find(key);
+        if(it != cache.end()) {
+            it->second.refs++;
+            if(it->second.loading) {
+                it->second.waiters.push_back(waiter);
+            } else {
+                result->textures[i] = it->second.info;
+                result->remaining--;
+            }
+            continue;
+        }
+        CacheEntry &e = cache[key];
+        e.refs = 1;
+        e.loading = true;
+        e.waiters.push_back(waiter);
+        decode.push_back(fnames[i]);
+        keys.push_back(key);
+    }
+    if(result->remaining == 0) {
+        ThreadPool::Instance().RunOnMain([result]() { result->done(result->textures); });
+    }
+    if(!decode.empty()) {
+        LoadBatch(decode, transparent, [this, keys](std::vector<TextureInfo> textures) {
+            for(size_t i = 0; i < keys.size(); i++) Loaded(keys[i], textures[i]);
+        });
+    }
+}
+
+void TextureLoader::Release(uint32_t tex) {
+    if(!tex) return;
+    auto k = cache_keys.find(tex);
+    if(k != cache_keys.end()) {
+        auto it = cache.find(k->second);
+        if(--it->second.refs > 0) return;
+        cache.erase(it);
+        cache_keys.erase(k);
+    }
+    glDeleteTextures(1, &tex);
+}
+
+void TextureLoader::Forget(const std::string &fname, bool transparent) {
+    auto it = cache.find(CacheKey(fname, transparent));
+    if(it == cache.end() || it->second.loading) return;
+    // Keep it under a key nothing will ask for, until its users release it
+    std::string stale = it->first + "#" + std::to_string(it->second.info.tex);
+    cache_keys[it->second.info.tex] = stale;
+    cache[stale] = std::move(it->second);
+    cache.erase(it);
+}
@@ -0,0 +1,78 @@
+#ifndef STAGE9_TEXTURELOADER_H
+#define STAGE9_TEXTURELOADER_H
+
+// Bytes of texture data uploaded per frame at most, past the first image
+#define TEXTURE_UPLOAD_BUDGET (4 * 1024 * 1024)
+
+typedef struct {
+    int w, h;
+    std::vector<uint8_t> rgba;
+} Image;
+
+typedef struct {
+    uint32_t tex;
+    int w, h;
+} TextureInfo;
+
+// Images are decoded (and colour keyed) on pool workers. Finished ones wait in a queue until
+// Pump() uploads them on the render thread, since that is the only thread with a GL context
+class TextureLoader {
+public:
+    static TextureLoader& Instance() {
+        static TextureLoader instance;
+        return instance;
+    }
+    TextureLoader(TextureLoader const&) = delete;
+    void operator=(TextureLoader const&)  = delete;
+
+    // done runs on the render thread once uploaded, with tex = 0 if the image couldn't be loaded
+    void Load(const std::string &fname, bool transparent, std::function<void(uint32_t tex, int w, int h)> done);
+    // Decodes all the images in parallel and only queues them for upload once every one is done.
+    // done gets the textures in the same order as fnames after the last one is uploaded
+    void LoadBatch(const std::vector<std::string> &fnames, bool transparent,
+                   std::function<void(std::vector<TextureInfo> textures)> done);
+    // Queues an image made on another thread for upload, it goes out with the decoded ones
+    void Queue(Image img, std::function<void(uint32_t tex, int w, int h)> done);
+    void Pump(size_t budget);
+
+    // Shared textures keyed by path, a sheet is only decoded and uploaded again once every
+    // user has released it. Callbacks always run on the render thread, after Acquire returns
+    void Acquire(const std::string &fname, bool transparent, std::function<void(TextureInfo texture)> done);
+    void AcquireBatch(const std::vector<std::string> &fnames, bool transparent,
+                      std::function<void(std::vector<TextureInfo> textures)> done);
+    // Drops a reference from Acquire, textures that didn't come from the cache are just deleted
+    void Release(uint32_t tex);
+    // The next Acquire of fname reads it from disk again, textures already handed out stay valid
+    void Forget(const std::string &fname, bool transparent);
+
+    // With transparent, every pixel matching the top left one becomes clear
+    static bool Decode(const std::string &fname, bool transparent, Image &img);
+    static uint32_t Upload(const Image &img);
+
+private:
+    TextureLoader() {}
+
+    typedef struct {
+        bool ok;
+        Image img;
+        std::function<void(uint32_t tex, int w, int h)> done;
+    } Pending;
+
+    std::mutex mutex;
+    std::list<Pending> ready;
+
+    // Render thread only
+    typedef struct {
+        TextureInfo info;
+        int refs;
+        bool loading;
+        std::vector<std::function<void(TextureInfo texture)>> waiters;
+    } CacheEntry;
+    std::unordered_map<std::string, CacheEntry> cache;
+    std::unordered_map<uint32_t, std::string> cache_keys;
+
+    static std::string CacheKey(const std::string &fname, bool transparent);
+    void Loaded(const std::string &key, TextureInfo info);
+};
+
+#endif //STAGE9_TEXTURELOADER_H
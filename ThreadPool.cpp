@@ -0,0 +1,54 @@
+#include "common.h"
+#include "ThreadPool.h"
+
+ThreadPool::ThreadPool() {
+    quit = false;
+    int count = max((int) std::thread::hardware_concurrency(), 2);
+    for(int i = 0; i < count; i++) workers.emplace_back(&ThreadPool::Worker, this);
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        quit = true;
+    }
+    cond.notify_all();
+    for(auto &t : workers) t.join();
+}
+
+void ThreadPool::Submit(std::function<void()> job) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        jobs.push_back(std::move(job));
+    }
+    cond.notify_one();
+}
+
+void ThreadPool::RunOnMain(std::function<void()> fn) {
+    std::lock_guard<std::mutex> lock(main_mutex);
+    main_jobs.push_back(std::move(fn));
+}
+
+void ThreadPool::Pump() {
+    std::vector<std::function<void()>> ready;
+    {
+        std::lock_guard<std::mutex> lock(main_mutex);
+        ready.swap(main_jobs);
+    }
+    for(auto &fn : ready) fn();
+}
+
+void ThreadPool::Worker() {
+    while(true) {
+        std::function<void()> job;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            cond.wait(lock, [this] { return quit || !jobs.empty(); });
+            // Finish whatever is queued before quitting, it may be a save
+            if(jobs.empty()) return;
+            job = std::move(jobs.front());
+            jobs.pop_front();
+        }
+        job();
+    }
+}
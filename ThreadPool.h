@@ -0,0 +1,35 @@
+#ifndef STAGE9_THREADPOOL_H
+#define STAGE9_THREADPOOL_H
+
+// Worker threads for anything that would stall the render thread (disk, decoding).
+// Jobs hand their results back with RunOnMain(), which is drained once per frame by Pump()
+class ThreadPool {
+public:
+    static ThreadPool& Instance() {
+        static ThreadPool instance;
+        return instance;
+    }
+    ThreadPool(ThreadPool const&) = delete;
+    void operator=(ThreadPool const&)  = delete;
+    ~ThreadPool();
+
+    void Submit(std::function<void()> job);
+    void RunOnMain(std::function<void()> fn);
+    void Pump();
+    int Workers() const { return (int) workers.size(); }
+
+private:
+    ThreadPool();
+
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable cond;
+    std::list<std::function<void()>> jobs;
+    std::mutex main_mutex;
+    std::vector<std::function<void()>> main_jobs;
+    bool quit;
+
+    void Worker();
+};
+
+#endif //STAGE9_THREADPOOL_H
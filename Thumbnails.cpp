@@ -0,0 +1,151 @@
+#include "common.h"
+
+#include "Preferences.h"
+#include "FileIO.h"
+#include "ThreadPool.h"
+#include "TileRender.h"
+#include "Thumbnails.h"
+
+namespace fs = std::filesystem;
+
+// Bump when thumbnails are drawn differently, so old ones in the cache aren't used
+#define THUMBNAIL_VERSION 1
+#define THUMBNAIL_BACKGROUND 0xFF000000u
+
+Thumbnails::Thumbnails() : state(std::make_shared<State>()) {}
+
+Thumbnails::~Thumbnails() {
+    Clear();
+}
+
+uint32_t Thumbnails::Key(const ProjectStage &stage) {
+    uint32_t parts[4] = { THUMBNAIL_VERSION, THUMBNAIL_SIZE, stage.files[PROJECT_PXM].hash,
+                          stage.files[PROJECT_TILESET].hash };
+    return HashBytes(parts, sizeof(parts));
+}
+
+std::string Thumbnails::CachePath(uint32_t key) {
+    char name[16];
+    snprintf(name, sizeof(name), "%08x.rgba", key);
+    return Preferences::Instance().DataPath() + "thumbs/" + name;
+}
+
+bool Thumbnails::LoadCached(uint32_t key, Image &img) {
+    FILE *file = fopen(CachePath(key).c_str(), "rb");
+    if(!file) return false;
+    Header header;
+    bool ok = fread(&header, sizeof(Header), 1, file) == 1 && memcmp(header.magic, "DTH1", 4) == 0
+            && header.key == key && header.w > 0 && header.h > 0 && header.w <= 0x10000 && header.h <= 0x10000;
+    if(ok) {
+        img.w = header.w;
+        img.h = header.h;
+        img.rgba.resize((size_t) img.w * img.h * 4);
+        ok = fread(img.rgba.data(), img.rgba.size(), 1, file) == 1;
+    }
+    fclose(file);
+    return ok;
+}
+
+void Thumbnails::StoreCached(uint32_t key, const Image &img) {
+    Header header;
+    memcpy(header.magic, "DTH1", 4);
+    header.key = key;
+    header.w = img.w;
+    header.h = img.h;
+    std::vector<uint8_t> data(sizeof(Header) + img.rgba.size());
+    memcpy(data.data(), &header, sizeof(Header));
+    memcpy(data.data() + sizeof(Header), img.rgba.data(), img.rgba.size());
+    std::string path = CachePath(key);
+    std::error_code ec;
+    fs::create_directories(fs::path(path).parent_path(), ec);
+    WriteFileAtomic(path, data.data(), data.size());
+}
+
+bool Thumbnails::Make(State &state, const std::string &pxm_fname, const std::string &tileset_fname,
+                      uint32_t tileset_hash, Image &img) {
+    std::vector<uint8_t> data;
+    if(!ReadAll(pxm_fname, data) || data.size() < 8 || memcmp(data.data(), "PXM", 3) != 0) return false;
+    int w = data[4] | (data[5] << 8), h = data[6] | (data[7] << 8);
+    if(w <= 0 || h <= 0 || data.size() < 8 + (size_t) w * h) return false;
+    int size = std::clamp(THUMBNAIL_SIZE / max(w, h), 1, TILE_SIZE);
+    // Tilesets are shared by a lot of stages, cut each one up once at each size
+    uint64_t sheet_key = ((uint64_t) tileset_hash << 32) | size;
+    std::shared_ptr<const TileSheet> sheet;
+    {
+        std::lock_guard<std::mutex> lock(state.sheets_mutex);
+        auto it = state.sheets.find(sheet_key);
+        if(it != state.sheets.end()) sheet = it->second.lock();
+    }
+    if(!sheet) {
+        Image tileset;
+        if(!TextureLoader::Decode(tileset_fname, true, tileset)) return false;
+        auto made = std::make_shared<TileSheet>();
+        MakeTileSheet(tileset, size, *made);
+        sheet = made;
+        std::lock_guard<std::mutex> lock(state.sheets_mutex);
+        state.sheets[sheet_key] = sheet;
+    }
+    img.w = w * size;
+    img.h = h * size;
+    img.rgba.resize((size_t) img.w * img.h * 4);
+    auto pixels = (uint32_t*) img.rgba.data();
+    std::fill(pixels, pixels + (size_t) img.w * img.h, THUMBNAIL_BACKGROUND);
+    CompositeTiles(data.data() + 8, w, h, *sheet, pixels);
+    return true;
+}
+
+TextureInfo Thumbnails::Get(const ProjectStage &stage) {
+    const std::string &pxm_fname = stage.files[PROJECT_PXM].path;
+    const std::string &tileset_fname = stage.files[PROJECT_TILESET].path;
+    if(pxm_fname.empty() || tileset_fname.empty()) return { 0, 0, 0 };
+    uint32_t key = Key(stage);
+    auto &entries = state->entries;
+    auto it = entries.find(pxm_fname);
+    if(it == entries.end()) {
+        it = entries.insert({ pxm_fname, { 0, { 0, 0, 0 }, false, false } }).first;
+    }
+    Entry &e = it->second;
+    if(e.key == key && (e.info.tex || e.pending || e.failed)) return e.info;
+    e.key = key;
+    e.pending = true;
+    e.failed = false;
+    uint32_t tileset_hash = stage.files[PROJECT_TILESET].hash;
+    // The job holds the state, not this, so a window closed mid-job just drops its result
+    auto shared = state;
+    ThreadPool::Instance().Submit([shared, key, pxm_fname, tileset_fname, tileset_hash]() {
+        Image img;
+        bool ok = LoadCached(key, img);
+        if(!ok && Make(*shared, pxm_fname, tileset_fname, tileset_hash, img)) {
+            StoreCached(key, img);
+            ok = true;
+        }
+        auto done = [shared, key, pxm_fname](uint32_t tex, int w, int h) {
+            // Cleared (or destroyed) since, the entries went with it
+            auto it = shared->entries.find(pxm_fname);
+            if(it == shared->entries.end() || it->second.key != key) {
+                TextureLoader::Instance().Release(tex);
+                return;
+            }
+            Entry &e = it->second;
+            e.pending = false;
+            if(!tex) {
+                e.failed = true;
+                return;
+            }
+            TextureLoader::Instance().Release(e.info.tex);
+            e.info = { tex, w, h };
+        };
+        if(ok) {
+            TextureLoader::Instance().Queue(std::move(img), done);
+        } else {
+            ThreadPool::Instance().RunOnMain([done]() { done(0, 0, 0); });
+        }
+    });
+    return e.info;
+}
+
+void Thumbnails::Clear() {
+    for(auto &it : state->entries) TextureLoader::Instance().Release(it.second.info.tex);
+    state->entries.clear();
+    state = std::make_shared<State>();
+}
@@ -0,0 +1,54 @@
+#ifndef STAGE9_THUMBNAILS_H
+#define STAGE9_THUMBNAILS_H
+
+#include "TextureLoader.h"
+#include "TileRender.h"
+#include "Project.h"
+
+// Longest side of a thumbnail in pixels, tiles are shrunk (down to one pixel) to fit it
+#define THUMBNAIL_SIZE 128
+
+// Map previews for the stage browser. Each one is composited from the map and its tileset on the
+// thread pool and goes through TextureLoader's upload queue, so a screen full of them never
+// stalls a frame. Finished pixels are kept under the preferences path keyed by the content hashes
+// of both files, so an unchanged stage is only ever drawn once
+class Thumbnails {
+public:
+    Thumbnails();
+    ~Thumbnails();
+    // Texture of the stage's thumbnail, with tex = 0 until it is ready (or if it can't be made).
+    // A stage whose map or tileset has changed keeps its old thumbnail until the new one is up
+    TextureInfo Get(const ProjectStage &stage);
+    void Clear();
+
+private:
+    typedef struct {
+        uint32_t key;
+        TextureInfo info;
+        bool pending, failed;
+    } Entry;
+
+    // Owned jointly with the jobs in flight, which can outlive this object (and a Clear())
+    typedef struct {
+        std::unordered_map<std::string, Entry> entries; // By map path, render thread only
+        // Stages sharing a tileset share its cut up tiles while they're being drawn
+        std::mutex sheets_mutex;
+        std::unordered_map<uint64_t, std::weak_ptr<const TileSheet>> sheets;
+    } State;
+    std::shared_ptr<State> state;
+
+    typedef struct {
+        char magic[4];
+        uint32_t key;
+        uint32_t w, h;
+    } Header;
+
+    static uint32_t Key(const ProjectStage &stage);
+    static std::string CachePath(uint32_t key);
+    static bool LoadCached(uint32_t key, Image &img);
+    static void StoreCached(uint32_t key, const Image &img);
+    static bool Make(State &state, const std::string &pxm_fname, const std::string &tileset_fname,
+                     uint32_t tileset_hash, Image &img);
+};
+
+#endif //STAGE9_THUMBNAILS_H
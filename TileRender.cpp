@@ -0,0 +1,185 @@
+#include "common.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define TILE_RENDER_SSE2
+#define TILE_RENDER_AVX2
+#endif
+
+#include "ThreadPool.h"
+#include "TileRender.h"
+
+void MakeTileSheet(const Image &tileset, int size, TileSheet &sheet) {
+    size = std::clamp(size, 1, TILE_SIZE);
+    int rows = tileset.h / TILE_SIZE;
+    sheet.size = size;
+    sheet.count = rows * TILESET_COLUMNS;
+    sheet.pixels.assign((size_t) sheet.count * size * size, 0);
+    sheet.coverage.assign(sheet.count, TILE_CLEAR);
+    auto src = (const uint32_t*) tileset.rgba.data();
+    int step = TILE_SIZE / size; // Source pixels per sheet pixel, the remainder is dropped
+    for(int t = 0; t < sheet.count; t++) {
+        int tx = (t % TILESET_COLUMNS) * TILE_SIZE, ty = (t / TILESET_COLUMNS) * TILE_SIZE;
+        if(tx + TILE_SIZE > tileset.w) continue;
+        uint32_t *dst = &sheet.pixels[(size_t) t * size * size];
+        for(int y = 0; y < size; y++) {
+            for(int x = 0; x < size; x++) {
+                if(step == 1) {
+                    dst[y * size + x] = src[(ty + y) * tileset.w + tx + x];
+                    continue;
+                }
+                // Average of the block, clear if most of it is
+                uint32_t sum[4] = { 0, 0, 0, 0 };
+                int solid = 0;
+                for(int sy = 0; sy < step; sy++) {
+                    for(int sx = 0; sx < step; sx++) {
+                        uint32_t p = src[(ty + y * step + sy) * tileset.w + tx + x * step + sx];
+                        if(!(p >> 24)) continue;
+                        for(int c = 0; c < 4; c++) sum[c] += (p >> (c * 8)) & 0xFF;
+                        solid++;
+                    }
+                }
+                if(solid * 2 < step * step) continue;
+                uint32_t p = 0;
+                for(int c = 0; c < 3; c++) p |= (sum[c] / solid) << (c * 8);
+                dst[y * size + x] = p | 0xFF000000u;
+            }
+        }
+        int clear = (int) std::count(dst, dst + size * size, 0u);
+        sheet.coverage[t] = clear == size * size ? TILE_CLEAR : clear == 0 ? TILE_SOLID : TILE_MIXED;
+    }
+}
+
+// Copies a tile with clear pixels, dst rows are pitch pixels apart
+typedef void (*BlitFn)(uint32_t *dst, size_t pitch, const uint32_t *src, int size);
+
+static void BlitKeyedScalar(uint32_t *dst, size_t pitch, const uint32_t *src, int size) {
+    for(int row = 0; row < size; row++, src += size, dst += pitch) {
+        for(int i = 0; i < size; i++) if(src[i]) dst[i] = src[i];
+    }
+}
+
+#ifdef TILE_RENDER_SSE2
+__attribute__((target("sse2")))
+static void BlitKeyedSse2(uint32_t *dst, size_t pitch, const uint32_t *src, int size) {
+    const __m128i zero = _mm_setzero_si128();
+    for(int row = 0; row < size; row++, src += size, dst += pitch) {
+        int i = 0;
+        for(; i + 4 <= size; i += 4) {
+            __m128i s = _mm_loadu_si128((const __m128i*) (src + i));
+            __m128i d = _mm_loadu_si128((const __m128i*) (dst + i));
+            // Clear source pixels are 0, so or-ing in the destination under them is enough
+            __m128i keep = _mm_cmpeq_epi32(s, zero);
+            _mm_storeu_si128((__m128i*) (dst + i), _mm_or_si128(s, _mm_and_si128(keep, d)));
+        }
+        for(; i < size; i++) if(src[i]) dst[i] = src[i];
+    }
+}
+#endif
+
+#ifdef TILE_RENDER_AVX2
+__attribute__((target("avx2")))
+static void BlitKeyedAvx2(uint32_t *dst, size_t pitch, const uint32_t *src, int size) {
+    if(size != TILE_SIZE) {
+        BlitKeyedSse2(dst, pitch, src, size);
+        return;
+    }
+    // A full size row is 16 pixels, two registers
+    const __m256i zero = _mm256_setzero_si256();
+    for(int row = 0; row < TILE_SIZE; row++, src += TILE_SIZE, dst += pitch) {
+        __m256i s0 = _mm256_loadu_si256((const __m256i*) src);
+        __m256i s1 = _mm256_loadu_si256((const __m256i*) (src + 8));
+        __m256i d0 = _mm256_loadu_si256((const __m256i*) dst);
+        __m256i d1 = _mm256_loadu_si256((const __m256i*) (dst + 8));
+        d0 = _mm256_or_si256(s0, _mm256_and_si256(_mm256_cmpeq_epi32(s0, zero), d0));
+        d1 = _mm256_or_si256(s1, _mm256_and_si256(_mm256_cmpeq_epi32(s1, zero), d1));
+        _mm256_storeu_si256((__m256i*) dst, d0);
+        _mm256_storeu_si256((__m256i*) (dst + 8), d1);
+    }
+}
+#endif
+
+static BlitFn ChooseBlit() {
+#ifdef TILE_RENDER_AVX2
+    if(__builtin_cpu_supports("avx2")) return BlitKeyedAvx2;
+#endif
+#ifdef TILE_RENDER_SSE2
+    if(__builtin_cpu_supports("sse2")) return BlitKeyedSse2;
+#endif
+    return BlitKeyedScalar;
+}
+
+// Tile rows y0 to y1
+static void CompositeRows(const uint8_t *tiles, int w, int y0, int y1, const TileSheet &sheet, uint32_t *out) {
+    static const BlitFn blit = ChooseBlit();
+    int size = sheet.size;
+    size_t pitch = (size_t) w * size;
+    for(int y = y0; y < y1; y++) {
+        for(int x = 0; x < w; x++) {
+            uint8_t t = tiles[y * w + x];
+            if(t >= sheet.count || sheet.coverage[t] == TILE_CLEAR) continue;
+            const uint32_t *src = &sheet.pixels[(size_t) t * size * size];
+            uint32_t *dst = out + (size_t) y * size * pitch + (size_t) x * size;
+            if(sheet.coverage[t] == TILE_MIXED) {
+                blit(dst, pitch, src, size);
+                continue;
+            }
+            for(int row = 0; row < size; row++, src += size, dst += pitch) memcpy(dst, src, size * 4);
+        }
+    }
+}
+
+void CompositeTiles(const uint8_t *tiles, int w, int h, const TileSheet &sheet, uint32_t *out) {
+    int bands = (h + COMPOSITE_BAND_ROWS - 1) / COMPOSITE_BAND_ROWS;
+    if((size_t) w * h * sheet.size * sheet.size <= COMPOSITE_PARALLEL_PIXELS || bands < 2) {
+        CompositeRows(tiles, w, 0, h, sheet, out);
+        return;
+    }
+    // Bands are claimed one at a time by whoever gets there first, the caller included. It only
+    // waits for bands somebody is already drawing, so it can't wait on a job stuck in the queue
+    typedef struct {
+        const uint8_t *tiles;
+        int w, h, bands;
+        const TileSheet *sheet;
+        uint32_t *out;
+        std::atomic<int> next;
+        int finished;
+        std::mutex mutex;
+        std::condition_variable cond;
+    } Work;
+    auto work = std::make_shared<Work>();
+    work->tiles = tiles;
+    work->w = w;
+    work->h = h;
+    work->bands = bands;
+    work->sheet = &sheet;
+    work->out = out;
+    work->next = 0;
+    work->finished = 0;
+    auto draw = [](Work &work) {
+        int band;
+        while((band = work.next++) < work.bands) {
+            int y0 = band * COMPOSITE_BAND_ROWS;
+            CompositeRows(work.tiles, work.w, y0, min(y0 + COMPOSITE_BAND_ROWS, work.h), *work.sheet, work.out);
+            std::lock_guard<std::mutex> lock(work.mutex);
+            if(++work.finished == work.bands) work.cond.notify_all();
+        }
+    };
+    int helpers = min(ThreadPool::Instance().Workers(), bands - 1);
+    for(int i = 0; i < helpers; i++) ThreadPool::Instance().Submit([work, draw]() { draw(*work); });
+    draw(*work);
+    std::unique_lock<std::mutex> lock(work->mutex);
+    work->cond.wait(lock, [&work]() { return work->finished == work->bands; });
+}
+
+void RenderMap(const PXM &pxm, const TileSheet &sheet, uint32_t background, Image &img) {
+    int w = pxm.Width(), h = pxm.Height();
+    std::vector<uint8_t> tiles((size_t) w * h);
+    pxm.Read(tiles.data());
+    img.w = w * sheet.size;
+    img.h = h * sheet.size;
+    img.rgba.resize((size_t) img.w * img.h * 4);
+    auto pixels = (uint32_t*) img.rgba.data();
+    std::fill(pixels, pixels + (size_t) img.w * img.h, background);
+    CompositeTiles(tiles.data(), w, h, sheet, pixels);
+}
@@ -0,0 +1,33 @@
+#ifndef STAGE9_TILERENDER_H
+#define STAGE9_TILERENDER_H
+
+#include "TextureLoader.h"
+#include "pxm.h"
+
+#define TILESET_COLUMNS 16
+// Maps with more pixels than this are drawn in bands of rows on the thread pool
+#define COMPOSITE_PARALLEL_PIXELS (512 * 512)
+#define COMPOSITE_BAND_ROWS 8
+
+enum { TILE_CLEAR, TILE_SOLID, TILE_MIXED };
+
+// The tiles of a tileset cut out one after another, each size*size pixels, so drawing a row
+// of a tile is a straight copy. Smaller sizes are box filtered down from the 16x16 tiles
+typedef struct {
+    int size;
+    int count;
+    std::vector<uint32_t> pixels; // RGBA, 0 is clear
+    std::vector<uint8_t> coverage; // TILE_CLEAR etc. for each tile, to skip or copy whole tiles
+} TileSheet;
+
+// tileset is colour keyed already (decoded with transparent), clear pixels are 0
+void MakeTileSheet(const Image &tileset, int size, TileSheet &sheet);
+// Draws a map of w*h tile indices over out (w*size by h*size pixels). Clear pixels of the
+// sheet leave out as it was, tiles past the end of the sheet aren't drawn. Rows of tiles are
+// blitted with SSE2/AVX2 where the CPU has them, and big maps are split across the thread pool
+// (the calling thread works on it too, so this is safe to call from a pool job)
+void CompositeTiles(const uint8_t *tiles, int w, int h, const TileSheet &sheet, uint32_t *out);
+// The whole of pxm into img, over background
+void RenderMap(const PXM &pxm, const TileSheet &sheet, uint32_t background, Image &img);
+
+#endif //STAGE9_TILERENDER_H
@@ -0,0 +1,153 @@
+#include "common.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define TSC_CODEC_SSE2 // x86-64 always has it, 32 bit builds check at run time like AVX2
+#define TSC_CODEC_AVX2
+#endif
+
+#include "TscCodec.h"
+#include "TscCommands.h"
+
+namespace fs = std::filesystem;
+
+// Enough of a script's start to tell if it's obfuscated
+#define TSC_SAMPLE_SIZE 0x1000
+#define TSC_READ_CHUNK 0x10000
+
+template<bool ENCODE>
+static void ConvertScalar(uint8_t *data, size_t len, uint8_t key) {
+    for(size_t i = 0; i < len; i++) {
+        if(data[i] != key) data[i] = ENCODE ? data[i] + key : data[i] - key;
+    }
+}
+
+#ifdef TSC_CODEC_SSE2
+template<bool ENCODE>
+__attribute__((target("sse2")))
+static size_t ConvertSse2(uint8_t *data, size_t len, uint8_t key) {
+    const __m128i k = _mm_set1_epi8((char) key);
+    size_t i = 0;
+    for(; i + 16 <= len; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*) (data + i));
+        // Bytes equal to the key get 0 added
+        __m128i d = _mm_andnot_si128(_mm_cmpeq_epi8(v, k), k);
+        v = ENCODE ? _mm_add_epi8(v, d) : _mm_sub_epi8(v, d);
+        _mm_storeu_si128((__m128i*) (data + i), v);
+    }
+    return i;
+}
+#endif
+
+#ifdef TSC_CODEC_AVX2
+template<bool ENCODE>
+__attribute__((target("avx2")))
+static size_t ConvertAvx2(uint8_t *data, size_t len, uint8_t key) {
+    const __m256i k = _mm256_set1_epi8((char) key);
+    size_t i = 0;
+    for(; i + 64 <= len; i += 64) {
+        __m256i a = _mm256_loadu_si256((const __m256i*) (data + i));
+        __m256i b = _mm256_loadu_si256((const __m256i*) (data + i + 32));
+        __m256i da = _mm256_andnot_si256(_mm256_cmpeq_epi8(a, k), k);
+        __m256i db = _mm256_andnot_si256(_mm256_cmpeq_epi8(b, k), k);
+        a = ENCODE ? _mm256_add_epi8(a, da) : _mm256_sub_epi8(a, da);
+        b = ENCODE ? _mm256_add_epi8(b, db) : _mm256_sub_epi8(b, db);
+        _mm256_storeu_si256((__m256i*) (data + i), a);
+        _mm256_storeu_si256((__m256i*) (data + i + 32), b);
+    }
+    return i;
+}
+#endif
+
+template<bool ENCODE>
+static void Convert(uint8_t *data, size_t len, uint8_t key) {
+    size_t done = 0;
+#ifdef TSC_CODEC_AVX2
+    static const bool avx2 = __builtin_cpu_supports("avx2");
+    if(avx2) done = ConvertAvx2<ENCODE>(data, len, key);
+#endif
+#ifdef TSC_CODEC_SSE2
+    static const bool sse2 = __builtin_cpu_supports("sse2");
+    if(sse2) done += ConvertSse2<ENCODE>(data + done, len - done, key);
+#endif
+    ConvertScalar<ENCODE>(data + done, len - done, key);
+}
+
+void TscCodec::Encode(uint8_t *data, size_t len) const {
+    Convert<true>(data, len, key);
+}
+
+void TscCodec::Decode(uint8_t *data, size_t len) const {
+    Convert<false>(data, len, key);
+}
+
+typedef struct {
+    int commands; // Known commands like <MSG
+    int control;  // Control characters other than tab and newlines
+} TscScore;
+
+static TscScore Score(const uint8_t *data, size_t len) {
+    TscScore score = { 0, 0 };
+    for(size_t i = 0; i < len; i++) {
+        uint8_t c = data[i];
+        if(c == '<' && i + 4 <= len && FindTscCommand((const char*) data + i + 1)) score.commands++;
+        else if(c < 0x20 && c != '\t' && c != '\n' && c != '\r') score.control++;
+    }
+    return score;
+}
+
+bool TscCodec::IsObfuscated(const uint8_t *data, size_t len, uint8_t key) {
+    // Plain scripts are text full of commands, decoding them turns both into noise.
+    // A script with no commands in either form is decided on which has less binary junk
+    uint8_t sample[TSC_SAMPLE_SIZE];
+    len = min(len, sizeof(sample));
+    memcpy(sample, data, len);
+    TscCodec(key).Decode(sample, len);
+    TscScore plain = Score(data, len), decoded = Score(sample, len);
+    if(plain.commands != decoded.commands) return decoded.commands > plain.commands;
+    return decoded.control < plain.control;
+}
+
+bool TscCodec::Read(const std::string &fname, std::string &text, bool &obfuscated) {
+    obfuscated = false;
+    text.clear();
+    FILE *file = fopen(fname.c_str(), "rb");
+    if(!file) return false;
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    if(size <= 0) {
+        fclose(file);
+        return size == 0;
+    }
+    // The key comes from the middle of the whole file, before anything is decoded
+    fseek(file, size / 2, SEEK_SET);
+    int key = fgetc(file);
+    fseek(file, 0, SEEK_SET);
+    text.resize(size);
+    size_t total = 0;
+    TscCodec codec((uint8_t) key);
+    while(total < (size_t) size) {
+        size_t n = fread(&text[total], 1, min((size_t) TSC_READ_CHUNK, size - total), file);
+        if(n == 0) break;
+        auto chunk = (uint8_t*) &text[total];
+        if(total == 0) obfuscated = key != EOF && IsObfuscated(chunk, n, key);
+        if(obfuscated) codec.Decode(chunk, n);
+        total += n;
+    }
+    fclose(file);
+    text.resize(strnlen(text.c_str(), total));
+    return true;
+}
+
+bool TscCodec::ReadHead(const std::string &script_fname, std::string &text, std::string &head_fname) {
+    bool obfuscated;
+    fs::path dir = fs::path(script_fname).parent_path();
+    for(auto &d : { dir, dir.parent_path() }) {
+        for(const char *name : { "Head.tsc", "Head.txt" }) {
+            if(!Read((d / name).string(), text, obfuscated)) continue;
+            head_fname = (d / name).string();
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,31 @@
+#ifndef STAGE9_TSCCODEC_H
+#define STAGE9_TSCCODEC_H
+
+// Obfuscated scripts have the middle byte of the file (the key) added to every byte except
+// the ones equal to it. Each byte is handled on its own, so a script can be converted in place
+// or in chunks of any size once the key is known
+class TscCodec {
+public:
+    explicit TscCodec(uint8_t key) : key(key) {}
+
+    // Key of a whole script
+    static uint8_t Key(const uint8_t *data, size_t len) { return len ? data[len / 2] : 0; }
+    // Whole scripts, in place
+    static void EncodeScript(uint8_t *data, size_t len) { TscCodec(Key(data, len)).Encode(data, len); }
+    static void DecodeScript(uint8_t *data, size_t len) { TscCodec(Key(data, len)).Decode(data, len); }
+    // Whether data, the start of a script with this key, reads better decoded than as is
+    static bool IsObfuscated(const uint8_t *data, size_t len, uint8_t key);
+    // Reads a script a chunk at a time, decoding each one as it comes in if the script
+    // is obfuscated. The text stops at the first NUL. Safe to call from a worker
+    static bool Read(const std::string &fname, std::string &text, bool &obfuscated);
+    // Head.tsc (or Head.txt) for a stage script, from the script's directory or the one above
+    static bool ReadHead(const std::string &script_fname, std::string &text, std::string &head_fname);
+
+    void Encode(uint8_t *data, size_t len) const;
+    void Decode(uint8_t *data, size_t len) const;
+
+private:
+    uint8_t key;
+};
+
+#endif //STAGE9_TSCCODEC_H
@@ -0,0 +1,177 @@
+#ifndef STAGE9_TSCCOMMANDS_H
+#define STAGE9_TSCCOMMANDS_H
+
+// What a command argument refers to, so tools can follow events, flags, maps and items
+enum {
+    TSC_ARG_NUMBER, TSC_ARG_EVENT, TSC_ARG_FLAG, TSC_ARG_SKIPFLAG, TSC_ARG_MAPFLAG, TSC_ARG_MAP,
+    TSC_ARG_ITEM, TSC_ARG_WEAPON, TSC_ARG_ENTITY, TSC_ARG_NPC, TSC_ARG_SOUND, TSC_ARG_MUSIC,
+    TSC_ARG_FACE, TSC_ARG_DIRECTION, TSC_ARG_TICKS, TSC_ARG_COORD, TSC_ARG_TILE,
+};
+
+#define TSC_MAX_ARGS 4
+// Every argument is 4 characters, with one separator character between them
+#define TSC_ARG_LEN 4
+
+typedef struct {
+    char name[4]; // After the '<'
+    uint8_t argc;
+    uint8_t args[TSC_MAX_ARGS];
+} TscCommand;
+
+inline constexpr TscCommand tsc_commands[] = {
+        { "AE+", 0, {} },
+        { "AM+", 2, { TSC_ARG_WEAPON, TSC_ARG_NUMBER } },
+        { "AM-", 1, { TSC_ARG_WEAPON } },
+        { "AMJ", 2, { TSC_ARG_WEAPON, TSC_ARG_EVENT } },
+        { "ANP", 3, { TSC_ARG_ENTITY, TSC_ARG_NUMBER, TSC_ARG_DIRECTION } },
+        { "BOA", 1, { TSC_ARG_NUMBER } },
+        { "BSL", 1, { TSC_ARG_ENTITY } },
+        { "CAT", 0, {} },
+        { "CIL", 0, {} },
+        { "CLO", 0, {} },
+        { "CLR", 0, {} },
+        { "CMP", 3, { TSC_ARG_COORD, TSC_ARG_COORD, TSC_ARG_TILE } },
+        { "CMU", 1, { TSC_ARG_MUSIC } },
+        { "CNP", 3, { TSC_ARG_ENTITY, TSC_ARG_NPC, TSC_ARG_DIRECTION } },
+        { "CPS", 0, {} },
+        { "CRE", 0, {} },
+        { "CSS", 0, {} },
+        { "DNA", 1, { TSC_ARG_NPC } },
+        { "DNP", 1, { TSC_ARG_ENTITY } },
+        { "ECJ", 2, { TSC_ARG_ENTITY, TSC_ARG_EVENT } },
+        { "END", 0, {} },
+        { "EQ+", 1, { TSC_ARG_NUMBER } },
+        { "EQ-", 1, { TSC_ARG_NUMBER } },
+        { "ESC", 0, {} },
+        { "EVE", 1, { TSC_ARG_EVENT } },
+        { "FAC", 1, { TSC_ARG_FACE } },
+        { "FAI", 1, { TSC_ARG_DIRECTION } },
+        { "FAO", 1, { TSC_ARG_DIRECTION } },
+        { "FL+", 1, { TSC_ARG_FLAG } },
+        { "FL-", 1, { TSC_ARG_FLAG } },
+        { "FLA", 0, {} },
+        { "FLJ", 2, { TSC_ARG_FLAG, TSC_ARG_EVENT } },
+        { "FMU", 0, {} },
+        { "FOB", 2, { TSC_ARG_ENTITY, TSC_ARG_TICKS } },
+        { "FOM", 1, { TSC_ARG_TICKS } },
+        { "FON", 2, { TSC_ARG_ENTITY, TSC_ARG_TICKS } },
+        { "FRE", 0, {} },
+        { "GIT", 1, { TSC_ARG_NUMBER } },
+        { "HMC", 0, {} },
+        { "INI", 0, {} },
+        { "INP", 3, { TSC_ARG_ENTITY, TSC_ARG_NPC, TSC_ARG_DIRECTION } },
+        { "IT+", 1, { TSC_ARG_ITEM } },
+        { "IT-", 1, { TSC_ARG_ITEM } },
+        { "ITJ", 2, { TSC_ARG_ITEM, TSC_ARG_EVENT } },
+        { "KEY", 0, {} },
+        { "LDP", 0, {} },
+        { "LI+", 1, { TSC_ARG_NUMBER } },
+        { "ML+", 1, { TSC_ARG_NUMBER } },
+        { "MLP", 0, {} },
+        { "MM0", 0, {} },
+        { "MNA", 0, {} },
+        { "MNP", 4, { TSC_ARG_ENTITY, TSC_ARG_COORD, TSC_ARG_COORD, TSC_ARG_DIRECTION } },
+        { "MOV", 2, { TSC_ARG_COORD, TSC_ARG_COORD } },
+        { "MP+", 1, { TSC_ARG_MAPFLAG } },
+        { "MPJ", 1, { TSC_ARG_EVENT } },
+        { "MS2", 0, {} },
+        { "MS3", 0, {} },
+        { "MSG", 0, {} },
+        { "MYB", 1, { TSC_ARG_DIRECTION } },
+        { "MYD", 1, { TSC_ARG_DIRECTION } },
+        { "NCJ", 2, { TSC_ARG_NPC, TSC_ARG_EVENT } },
+        { "NOD", 0, {} },
+        { "NUM", 1, { TSC_ARG_NUMBER } },
+        { "PRI", 0, {} },
+        { "PS+", 2, { TSC_ARG_NUMBER, TSC_ARG_EVENT } },
+        { "QUA", 1, { TSC_ARG_TICKS } },
+        { "RMU", 0, {} },
+        { "SAT", 0, {} },
+        { "SIL", 1, { TSC_ARG_NUMBER } },
+        { "SK+", 1, { TSC_ARG_SKIPFLAG } },
+        { "SK-", 1, { TSC_ARG_SKIPFLAG } },
+        { "SKJ", 2, { TSC_ARG_SKIPFLAG, TSC_ARG_EVENT } },
+        { "SLP", 0, {} },
+        { "SMC", 0, {} },
+        { "SMP", 2, { TSC_ARG_COORD, TSC_ARG_COORD } },
+        { "SNP", 4, { TSC_ARG_NPC, TSC_ARG_COORD, TSC_ARG_COORD, TSC_ARG_DIRECTION } },
+        { "SOU", 1, { TSC_ARG_SOUND } },
+        { "SPS", 0, {} },
+        { "SSS", 1, { TSC_ARG_NUMBER } },
+        { "STC", 0, {} },
+        { "SVP", 0, {} },
+        { "TAM", 3, { TSC_ARG_WEAPON, TSC_ARG_WEAPON, TSC_ARG_NUMBER } },
+        { "TRA", 4, { TSC_ARG_MAP, TSC_ARG_EVENT, TSC_ARG_COORD, TSC_ARG_COORD } },
+        { "TUR", 0, {} },
+        { "UNI", 1, { TSC_ARG_NUMBER } },
+        { "UNJ", 2, { TSC_ARG_NUMBER, TSC_ARG_EVENT } },
+        { "WAI", 1, { TSC_ARG_TICKS } },
+        { "WAS", 0, {} },
+        { "XX1", 1, { TSC_ARG_NUMBER } },
+        { "YNJ", 1, { TSC_ARG_EVENT } },
+        { "ZAM", 0, {} },
+};
+
+#define TSC_COMMAND_COUNT (sizeof(tsc_commands) / sizeof(tsc_commands[0]))
+
+// Perfect hash on the 3 bytes after '<': a multiply-shift into a table of TSC_HASH_SIZE slots,
+// with the multiplier searched for at compile time so no two commands share a slot
+#define TSC_HASH_BITS 10
+#define TSC_HASH_SIZE (1 << TSC_HASH_BITS)
+
+constexpr uint32_t TscKey(const char *name) {
+    return (uint8_t) name[0] | ((uint8_t) name[1] << 8) | ((uint32_t) (uint8_t) name[2] << 16);
+}
+
+constexpr uint32_t TscHash(uint32_t key, uint32_t mul) {
+    return (key * mul) >> (32 - TSC_HASH_BITS);
+}
+
+constexpr uint32_t TscFindMultiplier() {
+    for(uint32_t mul = 0x9E3779B1u, tries = 0; tries < 100000; mul += 2, tries++) {
+        bool used[TSC_HASH_SIZE] = {};
+        bool ok = true;
+        for(size_t i = 0; i < TSC_COMMAND_COUNT && ok; i++) {
+            uint32_t h = TscHash(TscKey(tsc_commands[i].name), mul);
+            ok = !used[h];
+            used[h] = true;
+        }
+        if(ok) return mul;
+    }
+    return 0;
+}
+
+inline constexpr uint32_t TSC_HASH_MUL = TscFindMultiplier();
+static_assert(TSC_HASH_MUL != 0, "No collision free multiplier for the TSC command table");
+
+typedef struct {
+    uint8_t index[TSC_HASH_SIZE]; // Command index + 1, 0 for empty slots
+} TscHashTable;
+
+constexpr TscHashTable TscBuildTable() {
+    TscHashTable table = {};
+    for(size_t i = 0; i < TSC_COMMAND_COUNT; i++) table.index[TscHash(TscKey(tsc_commands[i].name), TSC_HASH_MUL)] = i + 1;
+    return table;
+}
+
+inline constexpr TscHashTable tsc_hash_table = TscBuildTable();
+
+constexpr bool TscCheckTable() {
+    for(size_t i = 0; i < TSC_COMMAND_COUNT; i++) {
+        if(tsc_hash_table.index[TscHash(TscKey(tsc_commands[i].name), TSC_HASH_MUL)] != i + 1) return false;
+    }
+    return TSC_COMMAND_COUNT < 256;
+}
+static_assert(TscCheckTable(), "TSC command hash table is not perfect");
+
+// Command for the 3 characters at name (just past the '<'), NULL if there isn't one
+constexpr const TscCommand* FindTscCommand(const char *name) {
+    uint32_t key = TscKey(name);
+    uint8_t index = tsc_hash_table.index[TscHash(key, TSC_HASH_MUL)];
+    if(!index || TscKey(tsc_commands[index - 1].name) != key) return NULL;
+    return &tsc_commands[index - 1];
+}
+
+static_assert(FindTscCommand("TRA")->argc == 4 && FindTscCommand("XYZ") == NULL, "TSC command lookup");
+
+#endif //STAGE9_TSCCOMMANDS_H
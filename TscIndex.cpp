@@ -0,0 +1,62 @@
+#include "common.h"
+
+#include "TscIndex.h"
+
+// Labels found in lines starting within [from, to)
+void TscIndex::Scan(const char *text, size_t from, size_t to, std::vector<TscEvent> &out) {
+    for(size_t i = from; i < to; i++) {
+        if(i > 0 && text[i - 1] != '\n') {
+            const char *nl = (const char*) memchr(text + i, '\n', to - i);
+            if(!nl) break;
+            i = nl - text;
+            continue;
+        }
+        if(text[i] != '#') continue;
+        uint16_t event = 0;
+        int digits = 0;
+        while(digits < 4 && isdigit((uint8_t) text[i + 1 + digits])) {
+            event = event * 10 + (text[i + 1 + digits] - '0');
+            digits++;
+        }
+        if(digits == 4) out.push_back({ event, (uint32_t) i, 0 });
+    }
+}
+
+void TscIndex::Finish(size_t len) {
+    lookup.clear();
+    for(size_t i = 0; i < events.size(); i++) {
+        events[i].end = i + 1 < events.size() ? events[i + 1].start : (uint32_t) len;
+        lookup.emplace(events[i].event, (uint32_t) i);
+    }
+}
+
+void TscIndex::Build(const char *text, size_t len) {
+    events.clear();
+    Scan(text, 0, len, events);
+    Finish(len);
+}
+
+void TscIndex::Update(const char *text, size_t len, const ScriptEdit &edit) {
+    // Lines touched by the edit, in the new text. Everything past them is the old text moved
+    size_t from = edit.pos, to = edit.pos + edit.inserted;
+    while(from > 0 && text[from - 1] != '\n') from--;
+    while(to < len && text[to] != '\n') to++;
+    size_t old_to = to - edit.inserted + edit.removed;
+    std::vector<TscEvent> found;
+    Scan(text, from, to, found);
+    // Labels starting at old_to itself can't exist (it's a newline or the end) so only
+    // those past it have to be moved
+    auto first = std::lower_bound(events.begin(), events.end(), from,
+                                  [](const TscEvent &e, size_t pos) { return e.start < pos; });
+    auto last = std::lower_bound(first, events.end(), old_to,
+                                 [](const TscEvent &e, size_t pos) { return e.start < pos; });
+    for(auto it = last; it != events.end(); it++) it->start = it->start - edit.removed + edit.inserted;
+    first = events.erase(first, last);
+    events.insert(first, found.begin(), found.end());
+    Finish(len);
+}
+
+const TscEvent* TscIndex::Find(uint16_t event) const {
+    auto it = lookup.find(event);
+    return it == lookup.end() ? NULL : &events[it->second];
+}
@@ -0,0 +1,29 @@
+#ifndef STAGE9_TSCINDEX_H
+#define STAGE9_TSCINDEX_H
+
+#include "ScriptBuffer.h"
+
+typedef struct {
+    uint16_t event;
+    uint32_t start, end; // From the # of the label up to the next label or the end of the script
+} TscEvent;
+
+// Where every #NNNN event label is in the script. Built once when a script is loaded, then
+// edits only rescan the lines they touched and shift the events after them
+class TscIndex {
+public:
+    void Build(const char *text, size_t len);
+    void Update(const char *text, size_t len, const ScriptEdit &edit);
+    // Range of an event, NULL if the script doesn't have it. Duplicates resolve to the first one
+    const TscEvent* Find(uint16_t event) const;
+    const std::vector<TscEvent>& Events() const { return events; }
+
+private:
+    std::vector<TscEvent> events; // In script order
+    std::unordered_map<uint16_t, uint32_t> lookup; // Event number to index in events
+
+    static void Scan(const char *text, size_t from, size_t to, std::vector<TscEvent> &out);
+    void Finish(size_t len);
+};
+
+#endif //STAGE9_TSCINDEX_H
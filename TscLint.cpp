@@ -0,0 +1,307 @@
+#include "common.h"
+
+#include "Project.h"
+#include "ThreadPool.h"
+#include "TscCodec.h"
+#include "TscCommands.h"
+#include "TscLint.h"
+
+namespace fs = std::filesystem;
+
+#define TSC_EVENT_MAX 10000
+
+// Commands that leave the event, so nothing after them runs
+static bool IsTerminator(const TscCommand *cmd) {
+    static const char *names[] = { "END", "EVE", "TRA", "ESC", "INI", "LDP" };
+    for(auto name : names) if(cmd == FindTscCommand(name)) return true;
+    return false;
+}
+
+static bool ReadArg(const char *p, int &value) {
+    value = 0;
+    for(int i = 0; i < TSC_ARG_LEN; i++) {
+        if(!isdigit((uint8_t) p[i])) return false;
+        value = value * 10 + (p[i] - '0');
+    }
+    return true;
+}
+
+void LintScript(const std::string &fname, const char *text, size_t len, const LintContext &ctx,
+                std::vector<LintIssue> &out, std::vector<LintTransfer> *transfers) {
+    typedef struct {
+        const TscCommand *cmd;
+        int event;
+        uint32_t pos, line;
+    } EventRef;
+    const TscCommand *tra = FindTscCommand("TRA");
+    std::vector<EventRef> refs;
+    std::unordered_map<uint16_t, uint32_t> events; // Number to the line it's defined on
+    size_t first = out.size();
+    char msg[128];
+    auto report = [&](const char *p, uint32_t line, uint8_t kind) {
+        out.push_back({ fname, (uint32_t) (p - text), line, kind, msg });
+    };
+    // Event being read and whether the last command in it leaves it
+    const char *event_at = NULL;
+    uint32_t event_line = 0;
+    int event = 0;
+    bool terminated = false;
+    auto close_event = [&]() {
+        if(!event_at || terminated) return;
+        snprintf(msg, sizeof(msg), "#%04d runs into whatever comes after it", event);
+        report(event_at, event_line, LINT_UNTERMINATED);
+    };
+    const char *end = text + len, *eol = text;
+    uint32_t line = 0;
+    for(const char *p = text; p < end;) {
+        if(p == eol) {
+            // Start of a line
+            if(p > text) p++;
+            line++;
+            eol = (const char*) memchr(p, '\n', end - p);
+            if(!eol) eol = end;
+            int number;
+            if(eol - p >= 5 && *p == '#' && ReadArg(p + 1, number)) {
+                close_event();
+                event = number;
+                event_at = p;
+                event_line = line;
+                terminated = false;
+                auto it = events.emplace(event, line);
+                if(!it.second) {
+                    snprintf(msg, sizeof(msg), "#%04d is already defined on line %u", event, it.first->second);
+                    report(p, line, LINT_DUPLICATE_EVENT);
+                }
+                p += 5;
+            }
+            continue;
+        }
+        if(*p != '<') {
+            const char *lt = (const char*) memchr(p, '<', eol - p);
+            p = lt ? lt : eol;
+            continue;
+        }
+        const TscCommand *cmd = eol - p >= 4 ? FindTscCommand(p + 1) : NULL;
+        if(!cmd) {
+            snprintf(msg, sizeof(msg), "Unknown command <%.*s", (int) min(eol - p - 1, 3), p + 1);
+            report(p, line, LINT_UNKNOWN_COMMAND);
+            p = min(p + 4, eol);
+            continue;
+        }
+        terminated = IsTerminator(cmd);
+        const char *q = p + 4;
+        bool ok = true;
+        int map = -1;
+        for(int i = 0; i < cmd->argc && ok; i++) {
+            if(i > 0) q++; // Separator
+            int value;
+            ok = eol - q >= TSC_ARG_LEN && ReadArg(q, value);
+            if(!ok) break;
+            // <TRA's event is in the map it goes to, checked once that map's script is read
+            if(cmd->args[i] == TSC_ARG_EVENT && cmd != tra) refs.push_back({ cmd, value, (uint32_t) (p - text), line });
+            if(cmd->args[i] == TSC_ARG_EVENT && cmd == tra && transfers) {
+                transfers->push_back({ fname, (uint32_t) (p - text), line, map, value });
+            }
+            if(cmd->args[i] == TSC_ARG_MAP) {
+                map = value;
+                if(ctx.map_count >= 0 && value >= ctx.map_count) {
+                    snprintf(msg, sizeof(msg), "<%s to map %d, the stage table only has %d", cmd->name, value, ctx.map_count);
+                    report(p, line, LINT_MISSING_MAP);
+                }
+            }
+            q += TSC_ARG_LEN;
+        }
+        // Another argument right after the last one
+        if(ok && cmd->argc > 0 && eol - q >= 2 && *q == ':' && isdigit((uint8_t) q[1])) ok = false;
+        if(!ok) {
+            snprintf(msg, sizeof(msg), "<%s takes %d argument%s", cmd->name, cmd->argc, cmd->argc == 1 ? "" : "s");
+            report(p, line, LINT_BAD_ARGUMENTS);
+        }
+        p = ok ? q : p + 4;
+    }
+    close_event();
+    if(ctx.check_events) {
+        for(auto &r : refs) {
+            if(events.count(r.event) || ((size_t) r.event < ctx.global_events.size() && ctx.global_events[r.event])) continue;
+            snprintf(msg, sizeof(msg), "<%s to #%04d, which doesn't exist", r.cmd->name, r.event);
+            out.push_back({ fname, r.pos, r.line, LINT_MISSING_EVENT, msg });
+        }
+    }
+    std::stable_sort(out.begin() + first, out.end(), [](const LintIssue &a, const LintIssue &b) { return a.pos < b.pos; });
+}
+
+std::vector<std::string> FindScripts(const std::string &dir) {
+    std::vector<std::string> scripts;
+    std::error_code ec;
+    for(auto it = fs::recursive_directory_iterator(dir, fs::directory_options::skip_permission_denied, ec);
+            it != fs::recursive_directory_iterator(); it.increment(ec)) {
+        if(ec) break;
+        if(!it->is_regular_file(ec)) continue;
+        const fs::path &path = it->path();
+        std::string ext = path.extension().string();
+        std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+        if(ext == ".tsc" || (ext == ".txt" && path.parent_path().filename() == "tsc")) {
+            scripts.push_back(path.generic_string());
+        }
+    }
+    std::sort(scripts.begin(), scripts.end());
+    return scripts;
+}
+
+// Top level brace groups in the first table of a C source
+static int CountTableEntries(const std::string &src) {
+    int depth = 0, count = 0;
+    bool in_table = false;
+    for(size_t i = 0; i < src.length(); i++) {
+        char c = src[i];
+        if(c == '/' && src[i + 1] == '/') {
+            i = src.find('\n', i);
+            if(i == std::string::npos) break;
+        } else if(c == '/' && src[i + 1] == '*') {
+            i = src.find("*/", i + 2);
+            if(i == std::string::npos) break;
+            i++;
+        } else if(c == '"' || c == '\'') {
+            for(i++; i < src.length() && src[i] != c; i++) if(src[i] == '\\') i++;
+        } else if(c == '#' && (i == 0 || src[i - 1] == '\n')) {
+            i = src.find('\n', i);
+            if(i == std::string::npos) break;
+        } else if(c == '=' && depth == 0) {
+            in_table = true;
+        } else if(c == '{') {
+            if(++depth == 2 && in_table) count++;
+        } else if(c == '}') {
+            if(--depth == 0 && in_table) return count;
+        }
+    }
+    return in_table ? count : -1;
+}
+
+int FindStageCount(const std::string &dir, std::vector<std::string> *files) {
+    std::vector<StageTableEntry> table;
+    for(fs::path base : { fs::path(dir), fs::path(dir).parent_path() }) {
+        if(ReadStageTable(base.string(), table)) {
+            if(files) for(auto &e : table) files->push_back(e.filename);
+            return (int) table.size();
+        }
+        std::ifstream stream(base / "src/db/stage.c", std::ios::binary);
+        if(stream) {
+            std::string src((std::istreambuf_iterator<char>(stream)), std::istreambuf_iterator<char>());
+            return CountTableEntries(src);
+        }
+    }
+    return -1;
+}
+
+static bool IsHeadScript(const std::string &fname) {
+    std::string stem = fs::path(fname).stem().string();
+    std::transform(stem.begin(), stem.end(), stem.begin(), ::tolower);
+    return stem == "head";
+}
+
+static void LintFile(const std::string &fname, const LintContext &ctx, std::vector<LintIssue> &out,
+                     std::vector<bool> &events, std::vector<LintTransfer> &transfers) {
+    std::string text;
+    bool obfuscated;
+    events.assign(TSC_EVENT_MAX, false);
+    if(!TscCodec::Read(fname, text, obfuscated)) {
+        out.push_back({ fname, 0, 0, LINT_UNREADABLE, "Couldn't be read" });
+        return;
+    }
+    LintScript(fname, text.data(), text.length(), ctx, out, &transfers);
+    // Labels, same as the ones LintScript sees
+    for(size_t i = 0; i + 5 <= text.length(); i++) {
+        int event;
+        if((i == 0 || text[i - 1] == '\n') && text[i] == '#' && ReadArg(&text[i + 1], event)) events[event] = true;
+    }
+}
+
+void TscLinter::Start(const std::string &dir) {
+    auto r = std::make_shared<Run>();
+    r->total_known = false;
+    r->checked = r->total = 0;
+    r->started = std::chrono::steady_clock::now();
+    r->seconds = 0;
+    run = r;
+    issues.clear();
+    ThreadPool::Instance().Submit([this, r, dir]() {
+        std::vector<std::string> scripts = FindScripts(dir);
+        auto ctx = std::make_shared<LintContext>();
+        ctx->global_events.assign(TSC_EVENT_MAX, false);
+        ctx->map_count = FindStageCount(dir, &ctx->map_files);
+        ctx->check_events = true;
+        int total = (int) scripts.size();
+        ThreadPool::Instance().RunOnMain([this, r, ctx, total]() {
+            if(r != run) return;
+            r->total = total;
+            r->total_known = true;
+            r->ctx = ctx;
+        });
+        // Head.tsc goes first, the others need its events
+        std::vector<std::string> stages;
+        for(auto &fname : scripts) {
+            if(!IsHeadScript(fname)) {
+                stages.push_back(fname);
+                continue;
+            }
+            LintContext head = *ctx;
+            head.check_events = false;
+            Result result;
+            LintFile(fname, head, result.found, ctx->global_events, result.transfers);
+            ThreadPool::Instance().RunOnMain([this, r, result]() mutable { Finished(r, result); });
+        }
+        for(auto &fname : stages) {
+            ThreadPool::Instance().Submit([this, r, ctx, fname]() {
+                Result result;
+                result.fname = fname;
+                LintFile(fname, *ctx, result.found, result.events, result.transfers);
+                ThreadPool::Instance().RunOnMain([this, r, result]() mutable { Finished(r, result); });
+            });
+        }
+    });
+}
+
+void TscLinter::Finished(std::shared_ptr<Run> from, Result &result) {
+    if(from != run) return;
+    std::vector<LintIssue> &found = result.found;
+    if(!result.fname.empty()) {
+        // The first script of a stage wins, same as a map looks in Stage/ before tsc/
+        run->stage_events.emplace(fs::path(result.fname).stem().string(), std::move(result.events));
+    }
+    run->transfers.insert(run->transfers.end(), std::make_move_iterator(result.transfers.begin()),
+                          std::make_move_iterator(result.transfers.end()));
+    if(!found.empty()) {
+        auto at = std::upper_bound(issues.begin(), issues.end(), found[0].fname,
+                                   [](const std::string &f, const LintIssue &i) { return f < i.fname; });
+        issues.insert(at, std::make_move_iterator(found.begin()), std::make_move_iterator(found.end()));
+    }
+    if(++run->checked == run->total) {
+        CheckTransfers();
+        run->seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - run->started).count();
+    }
+}
+
+// <TRA events against the script of the map they go to. Maps the table doesn't name, or
+// that have no script, are left alone: there is nothing to tell a missing event by
+void TscLinter::CheckTransfers() {
+    const LintContext &ctx = *run->ctx;
+    char msg[128];
+    for(auto &t : run->transfers) {
+        if(t.map < 0 || (size_t) t.map >= ctx.map_files.size()) continue;
+        auto it = run->stage_events.find(ctx.map_files[t.map]);
+        if(it == run->stage_events.end() || it->second[t.event] || ctx.global_events[t.event]) continue;
+        snprintf(msg, sizeof(msg), "<TRA to #%04d, which %s doesn't have", t.event, ctx.map_files[t.map].c_str());
+        LintIssue issue = { t.fname, t.pos, t.line, LINT_MISSING_EVENT, msg };
+        AddIssue(issue);
+    }
+    run->stage_events.clear();
+    run->transfers.clear();
+}
+
+// Into its place among the issues of every script, by file then position
+void TscLinter::AddIssue(LintIssue &issue) {
+    auto at = std::upper_bound(issues.begin(), issues.end(), issue, [](const LintIssue &a, const LintIssue &b) {
+        return a.fname != b.fname ? a.fname < b.fname : a.pos < b.pos;
+    });
+    issues.insert(at, std::move(issue));
+}
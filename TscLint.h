@@ -0,0 +1,77 @@
+#ifndef STAGE9_TSCLINT_H
+#define STAGE9_TSCLINT_H
+
+enum {
+    LINT_UNKNOWN_COMMAND, LINT_BAD_ARGUMENTS, LINT_DUPLICATE_EVENT, LINT_MISSING_EVENT,
+    LINT_MISSING_MAP, LINT_UNTERMINATED, LINT_UNREADABLE, LINT_KIND_COUNT
+};
+
+typedef struct {
+    std::string fname;
+    uint32_t pos, line; // Byte in the decoded script and 1-based line it's on
+    uint8_t kind;
+    std::string message;
+} LintIssue;
+
+// What a script may refer to outside of itself
+typedef struct {
+    std::vector<bool> global_events; // Head.tsc events, which every stage can run
+    int map_count; // -1 when there's no stage table to check <TRA against
+    std::vector<std::string> map_files; // Stage file of each map, empty when the table doesn't name them
+    bool check_events; // Head.tsc can jump into whichever stage it's running in, so it doesn't
+} LintContext;
+
+// A <TRA, its event is only known to exist once the script of the map it goes to has been read
+typedef struct {
+    std::string fname;
+    uint32_t pos, line;
+    int map, event;
+} LintTransfer;
+
+// Appends whatever is wrong with one (decoded) script to out, and its <TRAs to transfers
+void LintScript(const std::string &fname, const char *text, size_t len, const LintContext &ctx,
+                std::vector<LintIssue> &out, std::vector<LintTransfer> *transfers = NULL);
+
+// Every script in a data directory: *.tsc anywhere under it, and *.txt in directories named tsc
+std::vector<std::string> FindScripts(const std::string &dir);
+// Number of stages in the game's stage table (stage.tbl, mrmap.bin or src/db/stage.c in or
+// just above dir), -1 if there isn't one. files gets each map's stage file when the table has them
+int FindStageCount(const std::string &dir, std::vector<std::string> *files = NULL);
+
+// Checks every script of a data directory on the thread pool. Issues come in a script at a
+// time on the main thread (through ThreadPool::Pump), sorted by file and position
+class TscLinter {
+public:
+    void Start(const std::string &dir);
+    bool Running() const { return run && (!run->total_known || run->checked < run->total); }
+    const std::vector<LintIssue>& Issues() const { return issues; }
+    int Checked() const { return run ? run->checked : 0; }
+    int Total() const { return run ? run->total : 0; }
+    double Seconds() const { return run ? run->seconds : 0; }
+
+private:
+    typedef struct {
+        bool total_known;
+        int checked, total;
+        std::chrono::steady_clock::time_point started;
+        double seconds;
+        // For checking <TRA events once every script is in
+        std::shared_ptr<const LintContext> ctx;
+        std::unordered_map<std::string, std::vector<bool>> stage_events; // By script name without extension
+        std::vector<LintTransfer> transfers;
+    } Run;
+    std::shared_ptr<Run> run; // Results from any other run are dropped
+    std::vector<LintIssue> issues;
+
+    typedef struct {
+        std::string fname;
+        std::vector<LintIssue> found;
+        std::vector<bool> events;
+        std::vector<LintTransfer> transfers;
+    } Result;
+    void Finished(std::shared_ptr<Run> from, Result &result);
+    void CheckTransfers();
+    void AddIssue(LintIssue &issue);
+};
+
+#endif //STAGE9_TSCLINT_H
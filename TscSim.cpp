@@ -0,0 +1,275 @@
+#include "common.h"
+
+#include "TscCodec.h"
+#include "TscCommands.h"
+#include "TscSim.h"
+
+#define SIM_STEP_LIMIT 100000
+
+static const int space_sizes[SIM_SPACE_COUNT] = { 8000, 64, 128, 256, 64 };
+static const char *space_names[SIM_SPACE_COUNT] = { "flag", "skipflag", "mapflag", "item", "weapon" };
+
+// Arguments are read the way the game does, digit by digit with no checking
+static int ArgValue(const char *p) {
+    return (p[0] - '0') * 1000 + (p[1] - '0') * 100 + (p[2] - '0') * 10 + (p[3] - '0');
+}
+
+static uint64_t HashState(uint16_t event, const TscSimState &state) {
+    uint32_t a = HashBytes(&event, sizeof(event)), b = HashBytes(&event, sizeof(event), 0x811C9DC5u ^ 0x5BD1E995u);
+    for(auto &bits : state.bits) {
+        a = HashBytes(bits.data(), bits.size(), a);
+        b = HashBytes(bits.data(), bits.size(), b);
+    }
+    return (uint64_t) a << 32 | b;
+}
+
+TscSim::TscSim() {
+    all_paths = false;
+    max_paths = 0;
+    Reset(false);
+}
+
+bool TscSim::Load(const std::string &fname) {
+    bool obfuscated;
+    if(!TscCodec::Read(fname, stage, obfuscated)) return false;
+    stage_fname = fname;
+    stage_index.Build(stage.data(), stage.length());
+    head.clear();
+    head_fname.clear();
+    if(!TscCodec::ReadHead(fname, head, head_fname)) head.clear();
+    head_index.Build(head.data(), head.length());
+    return true;
+}
+
+void TscSim::Reset(bool unknown) {
+    for(int i = 0; i < SIM_SPACE_COUNT; i++) initial.bits[i].assign(space_sizes[i], unknown ? SIM_UNKNOWN : SIM_CLEAR);
+}
+
+void TscSim::Set(int space, int id, uint8_t value) {
+    if(id >= 0 && id < space_sizes[space]) initial.bits[space][id] = value;
+}
+
+// The game puts Head.tsc in front of the stage's script, so its events win
+bool TscSim::FindEvent(uint16_t event, const char *&text, size_t &start, size_t &end) const {
+    const TscEvent *ev = head_index.Find(event);
+    text = head.data();
+    if(!ev) {
+        ev = stage_index.Find(event);
+        text = stage.data();
+    }
+    if(!ev) return false;
+    start = ev->start;
+    end = ev->end;
+    return true;
+}
+
+std::vector<TscSimPath> TscSim::Run(uint16_t event, bool all, size_t max) {
+    all_paths = all;
+    max_paths = max;
+    seen.clear();
+    paths.clear();
+    TscSimPath path;
+    path.state = initial;
+    path.end = SIM_END_END;
+    path.warp_map = path.warp_event = path.merged_with = -1;
+    Explore(event, path);
+    return std::move(paths);
+}
+
+void TscSim::Explore(uint16_t first, TscSimPath first_path) {
+    // Branches not taken yet, each one starts by entering an event. Last in first out, so a path
+    // is always run to its end before the next starts and its index is paths.size()
+    std::vector<std::pair<uint16_t, TscSimPath>> pending;
+    pending.emplace_back(first, std::move(first_path));
+    while(!pending.empty() && paths.size() < max_paths) {
+        uint16_t event = pending.back().first;
+        TscSimPath path = std::move(pending.back().second);
+        pending.pop_back();
+        const char *text = NULL;
+        size_t pos = 0, end = 0;
+        bool entering = true;
+        int steps = 0;
+        char note[64];
+        for(;;) {
+            if(entering) {
+                entering = false;
+                snprintf(note, sizeof(note), "#%04d", event);
+                path.trail.push_back(note);
+                size_t start;
+                if(!FindEvent(event, text, start, end)) {
+                    path.end = SIM_END_MISSING;
+                    break;
+                }
+                auto it = seen.emplace(HashState(event, path.state), (int) paths.size());
+                if(!it.second) {
+                    path.end = SIM_END_MERGED;
+                    path.merged_with = it.first->second;
+                    break;
+                }
+                pos = start + 5;
+            }
+            if(++steps > SIM_STEP_LIMIT) {
+                path.end = SIM_END_LIMIT;
+                break;
+            }
+            const char *p = (const char*) memchr(text + pos, '<', end - pos);
+            if(!p || text + end - p < 4) {
+                path.end = SIM_END_FELL;
+                break;
+            }
+            const TscCommand *cmd = FindTscCommand(p + 1);
+            if(!cmd || text + end - p < 4 + cmd->argc * (TSC_ARG_LEN + 1) - 1) {
+                pos = p - text + 1;
+                continue;
+            }
+            int args[TSC_MAX_ARGS];
+            for(int i = 0; i < cmd->argc; i++) args[i] = ArgValue(p + 4 + i * (TSC_ARG_LEN + 1));
+            size_t next = p - text + 4 + (cmd->argc ? cmd->argc * (TSC_ARG_LEN + 1) - 1 : 0);
+            std::string written(p, text + next);
+            pos = next;
+            auto set = [&](int space, int id, uint8_t value) {
+                if(id >= 0 && id < space_sizes[space]) path.state.bits[space][id] = value;
+                path.trail.push_back(written);
+            };
+            // Jumps if the condition holds. An unknown one splits the path in two, with the tracked
+            // ID (if any, space -1 is for things like the player's answer) set to match each side
+            auto branch = [&](int space, int id, int target, const char *yes, const char *no) {
+                bool tracked = space >= 0 && id >= 0 && id < space_sizes[space];
+                uint8_t value = tracked ? path.state.bits[space][id] : (uint8_t) SIM_UNKNOWN;
+                if(value == SIM_UNKNOWN && all_paths) {
+                    TscSimPath jumped = path;
+                    if(tracked) jumped.state.bits[space][id] = SIM_SET;
+                    jumped.trail.push_back(written + " (" + yes + ")");
+                    pending.emplace_back((uint16_t) target, std::move(jumped));
+                }
+                if(value == SIM_SET) {
+                    path.trail.push_back(written + " (" + yes + ")");
+                    event = (uint16_t) target;
+                    entering = true;
+                    return;
+                }
+                if(tracked) path.state.bits[space][id] = SIM_CLEAR;
+                path.trail.push_back(written + " (" + no + ")");
+            };
+            bool done = false;
+            switch(TscKey(cmd->name)) {
+                case TscKey("FL+"): set(SIM_FLAGS, args[0], SIM_SET); break;
+                case TscKey("FL-"): set(SIM_FLAGS, args[0], SIM_CLEAR); break;
+                case TscKey("SK+"): set(SIM_SKIPFLAGS, args[0], SIM_SET); break;
+                case TscKey("SK-"): set(SIM_SKIPFLAGS, args[0], SIM_CLEAR); break;
+                case TscKey("MP+"): set(SIM_MAPFLAGS, args[0], SIM_SET); break;
+                case TscKey("IT+"): set(SIM_ITEMS, args[0], SIM_SET); break;
+                case TscKey("IT-"): set(SIM_ITEMS, args[0], SIM_CLEAR); break;
+                case TscKey("AM+"): set(SIM_WEAPONS, args[0], SIM_SET); break;
+                case TscKey("AM-"): set(SIM_WEAPONS, args[0], SIM_CLEAR); break;
+                case TscKey("TAM"):
+                    if(args[0] >= 0 && args[0] < space_sizes[SIM_WEAPONS]) path.state.bits[SIM_WEAPONS][args[0]] = SIM_CLEAR;
+                    set(SIM_WEAPONS, args[1], SIM_SET);
+                    break;
+                case TscKey("FLJ"): branch(SIM_FLAGS, args[0], args[1], "jumped", "didn't jump"); break;
+                case TscKey("SKJ"): branch(SIM_SKIPFLAGS, args[0], args[1], "jumped", "didn't jump"); break;
+                case TscKey("ITJ"): branch(SIM_ITEMS, args[0], args[1], "jumped", "didn't jump"); break;
+                case TscKey("AMJ"): branch(SIM_WEAPONS, args[0], args[1], "jumped", "didn't jump"); break;
+                // Which map is current isn't known, nor anything about NPCs or the player
+                case TscKey("MPJ"): branch(-1, 0, args[0], "map flag set", "map flag clear"); break;
+                case TscKey("NCJ"):
+                case TscKey("ECJ"): branch(-1, 0, args[1], "NPC there", "no NPC"); break;
+                case TscKey("UNJ"): branch(-1, 0, args[1], "jumped", "didn't jump"); break;
+                case TscKey("YNJ"): branch(-1, 0, args[0], "no", "yes"); break;
+                case TscKey("EVE"):
+                    path.trail.push_back(written);
+                    event = (uint16_t) args[0];
+                    entering = true;
+                    break;
+                case TscKey("TRA"):
+                    path.trail.push_back(written);
+                    path.end = SIM_END_WARP;
+                    path.warp_map = args[0];
+                    path.warp_event = args[1];
+                    done = true;
+                    break;
+                case TscKey("END"):
+                case TscKey("ESC"):
+                case TscKey("INI"):
+                case TscKey("LDP"):
+                    path.trail.push_back(written);
+                    path.end = SIM_END_END;
+                    done = true;
+                    break;
+            }
+            if(done) break;
+        }
+        paths.push_back(std::move(path));
+        if(!all_paths) break;
+    }
+}
+
+static void SimUsage() {
+    printf("Usage: DoukutsuEdit --simulate <script> <event> [options]\n"
+           "  --all            Follow both sides of branches that can't be decided, listing every path\n"
+           "  --max-paths N    Stop after N paths (default 1000)\n"
+           "  --unknown        Start with every flag, item and weapon unknown instead of a new game\n"
+           "  --flag N         Start with flag N set (also --skipflag, --mapflag, --item, --weapon)\n"
+           "  --no-flag N      Start with flag N clear (also --no-skipflag, ...)\n");
+}
+
+int TscSimMain(int argc, char *argv[]) {
+    if(argc < 2) {
+        SimUsage();
+        return 2;
+    }
+    TscSim sim;
+    if(!sim.Load(argv[0])) {
+        printf("Couldn't read %s\n", argv[0]);
+        return 1;
+    }
+    int event = atoi(argv[1]);
+    bool all = false;
+    size_t max_paths = 1000;
+    // Start state is applied after --unknown, wherever it was given
+    std::vector<std::pair<int, std::pair<int, uint8_t>>> sets;
+    for(int i = 2; i < argc; i++) {
+        std::string opt = argv[i];
+        if(opt == "--all") {
+            all = true;
+        } else if(opt == "--unknown") {
+            sim.Reset(true);
+        } else if(opt == "--max-paths" && i + 1 < argc) {
+            int n = atoi(argv[++i]);
+            max_paths = max(1, n);
+        } else {
+            bool clear = opt.rfind("--no-", 0) == 0;
+            std::string name = opt.substr(clear ? 5 : 2);
+            int space = -1;
+            for(int s = 0; s < SIM_SPACE_COUNT; s++) if(name == space_names[s]) space = s;
+            if(space < 0 || opt.rfind("--", 0) != 0 || i + 1 >= argc) {
+                SimUsage();
+                return 2;
+            }
+            sets.push_back({ space, { atoi(argv[++i]), clear ? SIM_CLEAR : SIM_SET } });
+        }
+    }
+    for(auto &s : sets) sim.Set(s.first, s.second.first, s.second.second);
+    printf("Script: %s\n", sim.stage_fname.c_str());
+    printf("Head:   %s\n", sim.head_fname.empty() ? "(none)" : sim.head_fname.c_str());
+    auto started = std::chrono::steady_clock::now();
+    std::vector<TscSimPath> paths = sim.Run((uint16_t) event, all, max_paths);
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - started).count();
+    static const char *ends[] = { "ends", "warps", "merges", "jumps to a missing event", "runs off the end of an event",
+                                  "gives up (step limit)" };
+    for(size_t i = 0; i < paths.size(); i++) {
+        const TscSimPath &p = paths[i];
+        printf("\nPath %zu %s", i + 1, ends[p.end]);
+        if(p.end == SIM_END_WARP) printf(" to map %d event %04d", p.warp_map, p.warp_event);
+        if(p.end == SIM_END_MERGED) {
+            if(p.merged_with == (int) i) printf(" into itself (loop)");
+            else printf(" into path %d", p.merged_with + 1);
+        }
+        printf("\n ");
+        for(auto &step : p.trail) printf(" %s", step.c_str());
+        printf("\n");
+    }
+    printf("\n%zu path%s in %.2f ms%s\n", paths.size(), paths.size() == 1 ? "" : "s", ms,
+           paths.size() >= max_paths ? " (stopped at --max-paths)" : "");
+    return 0;
+}
@@ -0,0 +1,65 @@
+#ifndef STAGE9_TSCSIM_H
+#define STAGE9_TSCSIM_H
+
+#include "TscIndex.h"
+
+// State the simulator keeps, one byte per ID in each space
+enum { SIM_FLAGS, SIM_SKIPFLAGS, SIM_MAPFLAGS, SIM_ITEMS, SIM_WEAPONS, SIM_SPACE_COUNT };
+enum { SIM_CLEAR, SIM_SET, SIM_UNKNOWN };
+
+typedef struct {
+    std::vector<uint8_t> bits[SIM_SPACE_COUNT];
+} TscSimState;
+
+// How a path through the script stopped
+enum {
+    SIM_END_END,     // <END, <ESC, <INI or <LDP
+    SIM_END_WARP,    // <TRA, into another stage's script
+    SIM_END_MERGED,  // Reached an event in a state another path already ran it in
+    SIM_END_MISSING, // Jumped to an event that doesn't exist
+    SIM_END_FELL,    // Ran off the end of the event
+    SIM_END_LIMIT,   // Too many commands, probably an endless loop
+};
+
+typedef struct {
+    std::vector<std::string> trail; // Events entered, state changes and branch decisions
+    TscSimState state;
+    uint8_t end;
+    int warp_map, warp_event;
+    int merged_with; // Path that already went on from here, for SIM_END_MERGED
+} TscSimPath;
+
+// Runs events of a stage script (with Head.tsc) without the game. Flags, items and the like
+// are tracked, so branches on them go the way the game would. Branches on things it can't
+// know (the player's answer to <YNJ, unknown flags, NPCs) are followed both ways when
+// enumerating every path, and each (event, state) pair is only run once
+class TscSim {
+public:
+    TscSim();
+    // Reads the stage's script, and Head.tsc from the same or the parent directory
+    bool Load(const std::string &fname);
+    // Every ID starts out clear (a new game) or unknown
+    void Reset(bool unknown);
+    void Set(int space, int id, uint8_t value);
+    // One path taking the "no jump" side of unknown branches, or every path up to max_paths
+    std::vector<TscSimPath> Run(uint16_t event, bool all_paths, size_t max_paths = 1000);
+
+    std::string stage_fname, head_fname;
+
+private:
+    std::string stage, head;
+    TscIndex stage_index, head_index;
+    TscSimState initial;
+    std::unordered_map<uint64_t, int> seen; // Hash of event + state to the path that first got there
+    std::vector<TscSimPath> paths;
+    bool all_paths;
+    size_t max_paths;
+
+    bool FindEvent(uint16_t event, const char *&text, size_t &start, size_t &end) const;
+    void Explore(uint16_t event, TscSimPath path);
+};
+
+// --simulate command line, returns the exit code
+int TscSimMain(int argc, char *argv[]);
+
+#endif //STAGE9_TSCSIM_H
@@ -0,0 +1,158 @@
+#include "common.h"
+
+#define IMGUI_DEFINE_MATH_OPERATORS
+#include "imgui/imgui.h"
+#include "imgui/imgui_internal.h"
+
+#include "TscSyntax.h"
+#include "TscCommands.h"
+
+static const ImU32 token_colors[TSC_TOKEN_COUNT] = {
+        IM_COL32(0xE0, 0xE0, 0xE0, 0xFF), // Text
+        IM_COL32(0xFF, 0xD0, 0x40, 0xFF), // Label
+        IM_COL32(0x60, 0xB0, 0xFF, 0xFF), // Command
+        IM_COL32(0xFF, 0x90, 0x60, 0xFF), // Argument
+        IM_COL32(0xFF, 0x40, 0x40, 0xFF), // Error
+};
+
+static bool IsDigits(const char *s, const char *end, int count) {
+    if(end - s < count) return false;
+    for(int i = 0; i < count; i++) if(!isdigit((uint8_t) s[i])) return false;
+    return true;
+}
+
+void TscSyntax::Lex(const char *text, TscLine &line) {
+    line.tokens.clear();
+    const char *begin = text + line.start, *end = begin + line.len, *p = begin;
+    auto add = [&](const char *s, const char *e, uint8_t kind) {
+        // Neighbouring text merges into one token
+        if(kind == TSC_TOKEN_TEXT && !line.tokens.empty() && line.tokens.back().kind == TSC_TOKEN_TEXT
+                && line.tokens.back().start + line.tokens.back().len == (uint32_t) (s - begin)) {
+            line.tokens.back().len += e - s;
+            return;
+        }
+        line.tokens.push_back({ (uint32_t) (s - begin), (uint32_t) (e - s), kind });
+    };
+    if(p < end && *p == '#' && IsDigits(p + 1, end, 4)) {
+        add(p, p + 5, TSC_TOKEN_LABEL);
+        p += 5;
+    }
+    while(p < end) {
+        if(*p == '<' && end - p >= 4) {
+            const TscCommand *cmd = FindTscCommand(p + 1);
+            if(!cmd) {
+                add(p, p + 4, TSC_TOKEN_ERROR);
+                p += 4;
+                continue;
+            }
+            add(p, p + 4, TSC_TOKEN_COMMAND);
+            p += 4;
+            // The game reads arguments by position, 4 characters each with one character between them
+            for(int i = 0; i < cmd->argc; i++) {
+                if(i > 0 && p < end) {
+                    add(p, p + 1, TSC_TOKEN_TEXT);
+                    p++;
+                }
+                if(end - p < TSC_ARG_LEN) {
+                    // Runs into the next line
+                    if(p < end) add(p, end, TSC_TOKEN_ERROR);
+                    p = end;
+                    break;
+                }
+                add(p, p + TSC_ARG_LEN, IsDigits(p, end, TSC_ARG_LEN) ? TSC_TOKEN_ARGUMENT : TSC_TOKEN_ERROR);
+                p += TSC_ARG_LEN;
+            }
+            continue;
+        }
+        add(p, p + 1, TSC_TOKEN_TEXT);
+        p++;
+    }
+}
+
+void TscSyntax::Split(const char *text, size_t from, size_t to, std::vector<TscLine> &out) {
+    // [from, to] where to is the end of the text or a newline ending the last line
+    size_t start = from;
+    for(;;) {
+        const char *nl = (const char*) memchr(text + start, '\n', to - start);
+        size_t stop = nl ? nl - text : to;
+        TscLine line = { (uint32_t) start, (uint32_t) (stop - start), {} };
+        Lex(text, line);
+        out.push_back(std::move(line));
+        if(!nl) break;
+        start = stop + 1;
+    }
+}
+
+void TscSyntax::Build(const char *text, size_t len) {
+    lines.clear();
+    Split(text, 0, len, lines);
+}
+
+size_t TscSyntax::LineAt(size_t pos) const {
+    auto it = std::upper_bound(lines.begin(), lines.end(), pos,
+                               [](size_t p, const TscLine &l) { return p < l.start; });
+    return it == lines.begin() ? 0 : it - lines.begin() - 1;
+}
+
+void TscSyntax::Update(const char *text, size_t len, const ScriptEdit &edit) {
+    if(lines.empty()) {
+        Build(text, len);
+        return;
+    }
+    // Old lines from the one the edit starts on to the one it ends on get replaced
+    size_t first = LineAt(edit.pos), last = LineAt(edit.pos + edit.removed);
+    size_t from = lines[first].start, to = edit.pos + edit.inserted;
+    while(to < len && text[to] != '\n') to++;
+    std::vector<TscLine> relexed;
+    Split(text, from, to, relexed);
+    for(size_t i = last + 1; i < lines.size(); i++) lines[i].start = lines[i].start - edit.removed + edit.inserted;
+    lines.erase(lines.begin() + first, lines.begin() + last + 1);
+    lines.insert(lines.begin() + first, std::make_move_iterator(relexed.begin()), std::make_move_iterator(relexed.end()));
+}
+
+void TscSyntax::Draw(const char *label, const char *text) const {
+    ImGuiContext &g = *ImGui::GetCurrentContext();
+    ImGuiWindow *parent = ImGui::GetCurrentWindow();
+    ImGuiID id = parent->GetID(label);
+    // Same name BeginChildEx() gives the editor's child window
+    char name[256];
+    ImFormatString(name, IM_ARRAYSIZE(name), "%s/%s_%08X", parent->Name, label, id);
+    ImGuiWindow *child = ImGui::FindWindowByName(name);
+    if(!child || lines.empty()) return;
+    ImGuiInputTextState *state = ImGui::GetInputTextState(id);
+    ImFont *font = g.Font;
+    float size = g.FontSize;
+    ImVec2 origin = child->Pos + g.Style.FramePadding - ImVec2(state ? state->ScrollX : 0.0f, child->Scroll.y);
+    ImDrawList *dl = child->DrawList;
+    dl->PushClipRect(child->InnerClipRect.Min, child->InnerClipRect.Max);
+    // Only the lines that can be seen
+    size_t top = (size_t) max(0.0f, (child->InnerClipRect.Min.y - origin.y) / size);
+    size_t bottom = (size_t) max(0.0f, (child->InnerClipRect.Max.y - origin.y) / size) + 1;
+    for(size_t i = top; i < min(bottom, lines.size()); i++) {
+        const TscLine &line = lines[i];
+        const char *s = text + line.start;
+        float x = origin.x, y = origin.y + i * size;
+        for(auto &t : line.tokens) {
+            if(x > child->InnerClipRect.Max.x) break;
+            // Position from the width of everything before the token, like ImGui lays it out
+            float w = font->CalcTextSizeA(size, FLT_MAX, 0.0f, s + t.start, s + t.start + t.len).x;
+            if(x + w >= child->InnerClipRect.Min.x) {
+                dl->AddText(font, size, ImVec2(x, y), token_colors[t.kind], s + t.start, s + t.start + t.len);
+            }
+            x += w;
+        }
+    }
+    // The editor's own cursor uses the text colour, which is transparent
+    if(state && g.ActiveId == id) {
+        bool visible = !g.IO.ConfigInputTextCursorBlink || state->CursorAnim <= 0.0f || ImFmod(state->CursorAnim, 1.20f) <= 0.80f;
+        size_t pos = ImTextCountUtf8BytesFromStr(state->TextW.Data, state->TextW.Data + state->Stb.cursor);
+        size_t i = LineAt(pos);
+        if(visible && i < lines.size()) {
+            const char *s = text + lines[i].start;
+            float x = origin.x + font->CalcTextSizeA(size, FLT_MAX, 0.0f, s, text + pos).x;
+            float y = origin.y + i * size;
+            dl->AddLine(ImVec2(x, y + 0.5f), ImVec2(x, y + size - 1.5f), ImGui::GetColorU32(ImGuiCol_Text, 1.0f));
+        }
+    }
+    dl->PopClipRect();
+}
@@ -0,0 +1,40 @@
+#ifndef STAGE9_TSCSYNTAX_H
+#define STAGE9_TSCSYNTAX_H
+
+#include "ScriptBuffer.h"
+
+enum {
+    TSC_TOKEN_TEXT, TSC_TOKEN_LABEL, TSC_TOKEN_COMMAND, TSC_TOKEN_ARGUMENT, TSC_TOKEN_ERROR, TSC_TOKEN_COUNT
+};
+
+typedef struct {
+    uint32_t start, len; // Relative to the line, so lines after an edit only have to move
+    uint8_t kind;
+} TscToken;
+
+typedef struct {
+    uint32_t start, len; // Not counting the newline
+    std::vector<TscToken> tokens;
+} TscLine;
+
+// Script split into lines with the tokens of each one. Edits only re-lex the lines they touch,
+// the lines after them are moved but keep their tokens
+class TscSyntax {
+public:
+    void Build(const char *text, size_t len);
+    void Update(const char *text, size_t len, const ScriptEdit &edit);
+    const std::vector<TscLine>& Lines() const { return lines; }
+    // Line the byte at pos is on
+    size_t LineAt(size_t pos) const;
+    // Colours the visible part of the multiline editor submitted just before with the same label.
+    // The editor should be drawn with a transparent text colour, the cursor is drawn here too
+    void Draw(const char *label, const char *text) const;
+
+private:
+    std::vector<TscLine> lines;
+
+    static void Split(const char *text, size_t from, size_t to, std::vector<TscLine> &out);
+    static void Lex(const char *text, TscLine &line);
+};
+
+#endif //STAGE9_TSCSYNTAX_H
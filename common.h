@@ -5,9 +5,24 @@
 #include <cstring>
 
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <limits>
 #include <list>
 #include <locale>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
 #include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
 #include <vector>
 
 #define TILE_SIZE	16
@@ -23,6 +38,13 @@ typedef uint16_t u16;
 typedef uint32_t u32;
 typedef uint32_t u64;
 
+// FNV-1a, pass the previous result as seed to hash several buffers together
+static inline uint32_t HashBytes(const void *data, size_t len, uint32_t seed = 2166136261u) {
+    auto bytes = (const uint8_t*) data;
+    for(size_t i = 0; i < len; i++) seed = (seed ^ bytes[i]) * 16777619u;
+    return seed;
+}
+
 // trim from start (in place)
 static inline void ltrim(std::string &s) {
     s.erase(s.begin(), std::find_if(s.begin(), s.end(), [](unsigned char ch) {
@@ -8,12 +8,32 @@
 #include "glad.h"
 
 #include "StageWindow.h"
+#include "TscSim.h"
+#include "MapExport.h"
 
 int main(int argc, char *argv[]) {
+    // Command line tools, these run without a window
+    if(argc > 1 && strcmp(argv[1], "--simulate") == 0) return TscSimMain(argc - 2, argv + 2);
+    if(argc > 1 && strcmp(argv[1], "--export-png") == 0) return ExportMain(argc - 2, argv + 2);
+
+#ifdef DEBUG
+    // Startup timing breakdown, each step is measured from the end of the previous one
+    auto startTime = std::chrono::steady_clock::now();
+    auto lapTime = startTime;
+    auto lap = [&](const char *what) {
+        auto now = std::chrono::steady_clock::now();
+        printf("Startup: %-14s %7.1f ms\n", what, std::chrono::duration<double, std::milli>(now - lapTime).count());
+        lapTime = now;
+    };
+#define STARTUP_LAP(what) lap(what)
+#else
+#define STARTUP_LAP(what)
+#endif
     if (SDL_Init(SDL_INIT_EVERYTHING) != 0) {
         printf("Error: %s\n", SDL_GetError());
         return 1;
     }
+    STARTUP_LAP("SDL");
 
     // Decide GL+GLSL versions
 #if defined(IMGUI_IMPL_OPENGL_ES2)
@@ -49,6 +69,7 @@ int main(int argc, char *argv[]) {
     SDL_GL_MakeCurrent(window, gl_context);
     gladLoadGLLoader((GLADloadproc)SDL_GL_GetProcAddress);
     SDL_GL_SetSwapInterval(1); // Enable vsync
+    STARTUP_LAP("Window + GL");
     // Setup Dear ImGui context
     IMGUI_CHECKVERSION();
     ImGui::CreateContext();
@@ -69,6 +90,7 @@ int main(int argc, char *argv[]) {
     // Setup Platform/Renderer backends
     ImGui_ImplSDL2_InitForOpenGL(window, gl_context);
     ImGui_ImplOpenGL3_Init(glsl_version);
+    STARTUP_LAP("ImGui");
 
     // Load Fonts
     // - If no fonts are loaded, dear imgui will use the default font. You can also load multiple fonts and use ImGui::PushFont()/PopFont() to select them.
@@ -86,6 +108,7 @@ int main(int argc, char *argv[]) {
     //IM_ASSERT(font != NULL);
 
     auto *stageWindow = new StageWindow();
+    STARTUP_LAP("StageWindow");
 
     // Main loop
     bool done = false;
@@ -121,6 +144,13 @@ int main(int argc, char *argv[]) {
         glClear(GL_COLOR_BUFFER_BIT);
         ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
         SDL_GL_SwapWindow(window);
+#ifdef DEBUG
+        if(ImGui::GetFrameCount() == 1) {
+            STARTUP_LAP("First frame");
+            printf("Startup: %-14s %7.1f ms\n", "Total", std::chrono::duration<double, std::milli>(
+                    std::chrono::steady_clock::now() - startTime).count());
+        }
+#endif
     }
 
     // Cleanup
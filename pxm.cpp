@@ -1,39 +1,111 @@
 #include "common.h"
 #include "pxm.h"
 
+// Every untouched chunk points here until it is written to
+const std::shared_ptr<PXM::Chunk>& PXM::EmptyChunk() {
+    static std::shared_ptr<Chunk> empty = std::make_shared<Chunk>();
+    return empty;
+}
+
+bool PXM::Equals(const PXM &other) const {
+    if(width != other.width || height != other.height) return false;
+    for(size_t i = 0; i < chunks.size(); i++) {
+        if(chunks[i] == other.chunks[i]) continue;
+        if(memcmp(chunks[i]->tiles, other.chunks[i]->tiles, sizeof(Chunk)) != 0) return false;
+    }
+    return true;
+}
+
+uint32_t PXM::Hash() const {
+    std::vector<uint8_t> tiles(width * height);
+    Read(tiles.data());
+    uint32_t hash = HashBytes(&width, 2);
+    hash = HashBytes(&height, 2, hash);
+    return HashBytes(tiles.data(), tiles.size(), hash);
+}
+
 void PXM::Resize(uint16_t _width, uint16_t _height) {
-    uint8_t *temp = (uint8_t*) calloc(_width * _height, 1);
-    for(uint16_t y = 0; y < _height && y < height; y++) {
-        memcpy(&temp[y * _width], &tiles[y * width], min(width, _width));
+    uint16_t _chunks_w = (_width + PXM_CHUNK - 1) / PXM_CHUNK;
+    uint16_t _chunks_h = (_height + PXM_CHUNK - 1) / PXM_CHUNK;
+    std::vector<std::shared_ptr<Chunk>> temp(_chunks_w * _chunks_h, EmptyChunk());
+    for(uint16_t cy = 0; cy < _chunks_h && cy < chunks_h; cy++) {
+        for(uint16_t cx = 0; cx < _chunks_w && cx < chunks_w; cx++) {
+            std::shared_ptr<Chunk> &c = temp[cy * _chunks_w + cx];
+            c = chunks[cy * chunks_w + cx];
+            // Chunks the new edge cuts through need the cropped tiles cleared
+            int keep_w = min(PXM_CHUNK, _width - cx * PXM_CHUNK);
+            int keep_h = min(PXM_CHUNK, _height - cy * PXM_CHUNK);
+            int used_w = min(PXM_CHUNK, width - cx * PXM_CHUNK);
+            int used_h = min(PXM_CHUNK, height - cy * PXM_CHUNK);
+            if(keep_w >= used_w && keep_h >= used_h) continue;
+            c = std::make_shared<Chunk>(*c);
+            for(int y = 0; y < PXM_CHUNK; y++) {
+                if(y >= keep_h) memset(&c->tiles[y * PXM_CHUNK], 0, PXM_CHUNK);
+                else if(keep_w < PXM_CHUNK) memset(&c->tiles[y * PXM_CHUNK + keep_w], 0, PXM_CHUNK - keep_w);
+            }
+        }
     }
-    free(tiles);
     width = _width;
     height = _height;
-    tiles = temp;
+    chunks_w = _chunks_w;
+    chunks_h = _chunks_h;
+    chunks.swap(temp);
 }
 
 void PXM::SetTile(uint16_t x, uint16_t y, uint8_t tile) {
-    if(x < width && y < height) tiles[y * width + x] = tile;
+    if(x >= width || y >= height) return;
+    std::shared_ptr<Chunk> &c = chunks[(y / PXM_CHUNK) * chunks_w + x / PXM_CHUNK];
+    uint8_t &t = c->tiles[(y % PXM_CHUNK) * PXM_CHUNK + x % PXM_CHUNK];
+    if(t == tile) return;
+    if(c.use_count() > 1) {
+        c = std::make_shared<Chunk>(*c);
+        c->tiles[(y % PXM_CHUNK) * PXM_CHUNK + x % PXM_CHUNK] = tile;
+    } else {
+        t = tile;
+    }
 }
 
 void PXM::Clear() {
-    memset(tiles, 0, width * height);
+    std::fill(chunks.begin(), chunks.end(), EmptyChunk());
+}
+
+void PXM::Read(uint8_t *dst) const {
+    for(uint16_t y = 0; y < height; y++) {
+        for(uint16_t cx = 0; cx < chunks_w; cx++) {
+            const Chunk *c = ChunkAt(cx * PXM_CHUNK, y);
+            int w = min(PXM_CHUNK, width - cx * PXM_CHUNK);
+            memcpy(&dst[y * width + cx * PXM_CHUNK], &c->tiles[(y % PXM_CHUNK) * PXM_CHUNK], w);
+        }
+    }
 }
 
 void PXM::Load(FILE *file) {
     char head[4];
+    uint16_t w = 0, h = 0;
     fread(head, 1, 4, file);
-    fread(&width, 2, 1, file);
-    fread(&height, 2, 1, file);
+    fread(&w, 2, 1, file);
+    fread(&h, 2, 1, file);
+    uint8_t *tiles = (uint8_t*) calloc(w * h, 1);
+    fread(tiles, 1, w * h, file);
+    Resize(0, 0);
+    Resize(w, h);
+    for(uint16_t y = 0; y < h; y++) {
+        for(uint16_t x = 0; x < w; x++) SetTile(x, y, tiles[y * w + x]);
+    }
     free(tiles);
-    tiles = (uint8_t*) calloc(width * height, 1);
-    fread(tiles, 1, width * height, file);
 }
 
-void PXM::Save(FILE *file) {
+void PXM::Save(FILE *file) const {
+    std::vector<uint8_t> buf;
+    Save(buf);
+    fwrite(buf.data(), 1, buf.size(), file);
+}
+
+void PXM::Save(std::vector<uint8_t> &buf) const {
     static const char head[4] = "PXM";
-    fwrite(head, 1, 4, file);
-    fwrite(&width, 2, 1, file);
-    fwrite(&height, 2, 1, file);
-    fwrite(tiles, 1, width * height, file);
+    buf.resize(8 + width * height);
+    memcpy(&buf[0], head, 4);
+    memcpy(&buf[4], &width, 2);
+    memcpy(&buf[6], &height, 2);
+    Read(&buf[8]);
 }
@@ -1,25 +1,45 @@
 #pragma once
 
+#define PXM_CHUNK 16
+
 class PXM {
 public:
     PXM() : PXM(20, 15) {}
-    PXM(uint16_t _width, uint16_t _height) : width(_width), height(_height) {
-        tiles = (uint8_t*) calloc(width * height, 1);
+    PXM(uint16_t _width, uint16_t _height) : width(0), height(0), chunks_w(0), chunks_h(0) {
+        Resize(_width, _height);
     }
-    ~PXM() { free(tiles); }
     uint16_t Width() const { return width; }
     uint16_t Height() const { return height; }
-    uint8_t Tile(uint16_t x, uint16_t y) {
-        return x < width ? y < height ? tiles[x + y * width] : 0 : 0;
+    uint8_t Tile(uint16_t x, uint16_t y) const {
+        return x < width ? y < height ? ChunkAt(x, y)->tiles[(y % PXM_CHUNK) * PXM_CHUNK + x % PXM_CHUNK] : 0 : 0;
     }
 
+    // Copies share every chunk with this map, so taking one only costs a pointer per chunk.
+    // Whichever side writes to a shared chunk afterwards gets its own copy of it
+    PXM Snapshot() const { return *this; }
+    bool Equals(const PXM &other) const;
+    uint32_t Hash() const;
+
     void Resize(uint16_t _width, uint16_t _height);
     void SetTile(uint16_t x, uint16_t y, uint8_t tile);
     void Clear();
     //void Shift(int16_t x, int16_t y);
+    void Read(uint8_t *dst) const;
     void Load(FILE *file);
-    void Save(FILE *file);
+    void Save(FILE *file) const;
+    void Save(std::vector<uint8_t> &buf) const;
 private:
+    // Tiles past the edge of the map are always 0, so chunks can be shared when the map grows
+    struct Chunk {
+        uint8_t tiles[PXM_CHUNK * PXM_CHUNK];
+    };
     uint16_t width, height;
-    uint8_t *tiles;
+    uint16_t chunks_w, chunks_h;
+    std::vector<std::shared_ptr<Chunk>> chunks;
+
+    static const std::shared_ptr<Chunk>& EmptyChunk();
+
+    const Chunk* ChunkAt(uint16_t x, uint16_t y) const {
+        return chunks[(y / PXM_CHUNK) * chunks_w + x / PXM_CHUNK].get();
+    }
 };